@@ -8,11 +8,11 @@ namespace FclEx
 	namespace Node
 	{
 		template<typename T, class TNode, typename Allocator>
-		class BaseBinaryTreeNode : public BaseNode<T, TNode, Allocator>
+		class BaseBinaryTreeNode : public Node::BaseNode<T, TNode, Allocator>
 		{
 		public:
 
-			using BaseNode = BaseNode<T, TNode, Allocator>;
+			using BaseNode = Node::BaseNode<T, TNode, Allocator>;
 			using PNode = typename BaseNode::PNode;
 
 			PNode& LeftChild = BaseNode::_neighborNodes[0];
@@ -13,9 +13,9 @@ namespace FclEx
 		using namespace Node;
 
 		template<class TKey, class TValue, typename Allocator>
-		class BinarySearchTreeNode :public BaseBinaryTreeNode<pair<TKey, TValue>, BaseBinaryTreeNode<TKey, TValue, Allocator>, Allocator>
+		class BinarySearchTreeNode :public Node::BaseBinaryTreeNode<pair<TKey, TValue>, Node::BaseBinaryTreeNode<TKey, TValue, Allocator>, Allocator>
 		{
-			using BaseBinaryTreeNode = BaseBinaryTreeNode<TKey, TValue, Allocator>;
+			using BaseBinaryTreeNode = Node::BaseBinaryTreeNode<TKey, TValue, Allocator>;
 			using BaseNode = typename BaseBinaryTreeNode::BaseNode;
 			using PNode = typename BaseNode::PNode;
 
@@ -0,0 +1,278 @@
+#pragma once
+
+#include "Define.h"
+#include "Comparer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+namespace FclEx
+{
+	namespace Collections
+	{
+		using namespace std;
+
+		// A Bloom filter whose bits for a key all lie in one 64-byte block, so a query touches a single cache line.
+		// Keys cannot be taken out of a Bloom filter; removals are only counted, and the owner rebuilds the filter
+		// from its keys once NeedsRebuild says the added and removed keys together exceed the capacity.
+		// Lookups count how often the filter answered by itself, see HitRate. The counters are atomic, so concurrent
+		// readers of the owner may share the filter.
+		template<typename TKey, typename THash = hash<TKey>>
+		class BlockedBloomFilter
+		{
+		public:
+
+			static constexpr bool Enabled = true;
+
+			// The filter is sized for capacity keys at about the given false positive rate; rebuilds keep the rate.
+			explicit BlockedBloomFilter(SizeType capacity = 1024, double falsePositiveRate = 0.01) :
+				_minCapacity(capacity == 0 ? 1 : capacity),
+				_bitsPerKey(-log(falsePositiveRate) / (log(2.0) * log(2.0)))
+			{
+				// The optimal number of bits per key is bitsPerKey * ln 2.
+				var hashes = static_cast<Int32>(_bitsPerKey * log(2.0) + 0.5);
+				_hashes = hashes < 1 ? 1 : hashes > MaxHashes ? MaxHashes : hashes;
+				Reset(0);
+			}
+
+			// The copy lays its blocks out on its own cache lines, as its words may be aligned differently.
+			BlockedBloomFilter(const BlockedBloomFilter &other) :
+				_minCapacity(other._minCapacity),
+				_bitsPerKey(other._bitsPerKey),
+				_hash(other._hash),
+				_hashes(other._hashes),
+				_capacity(other._capacity),
+				_blockMask(other._blockMask),
+				_added(other._added),
+				_words(other._words.size(), 0),
+				_lookups(other._lookups),
+				_rejections(other._rejections)
+			{
+				_offset = AlignedOffset();
+				var first = other._words.begin() + other._offset;
+				copy(first, first + (other._blockMask + 1) * BlockWords, _words.begin() + _offset);
+			}
+
+			BlockedBloomFilter(BlockedBloomFilter &&) = default;
+
+			BlockedBloomFilter &operator=(const BlockedBloomFilter &other)
+			{
+				if (this != &other) *this = BlockedBloomFilter(other);
+				return *this;
+			}
+
+			BlockedBloomFilter &operator=(BlockedBloomFilter &&) = default;
+
+			void Add(const TKey &key)
+			{
+				var h = Mix(static_cast<UInt64>(_hash(key)));
+				var block = Block(h);
+				var a = static_cast<UInt32>(h >> 32);
+				var b = static_cast<UInt32>(h) | 1;
+				for (var i = 0; i < _hashes; ++i, a += b)
+				{
+					block[(a & BlockMask) >> 6] |= UInt64(1) << (a & 63);
+				}
+				++_added;
+			}
+
+			// False only for keys that were never added since the last Reset or Clear.
+			bool MayContain(const TKey &key) const
+			{
+				return Probe(static_cast<UInt64>(_hash(key)));
+			}
+
+			// Keys of another type, met by owners with a transparent comparer, are hashed directly by a transparent hash,
+			// or else converted to TKey; keys of a type TKey cannot be made from are let through.
+			template<typename K>
+			bool MayContain(const K &key) const
+			{
+				return MayContainOther(key, IsTransparent<THash>());
+			}
+
+			void Removed(SizeType count)
+			{
+				_added += count;
+			}
+
+			// Whether the keys set in the filter, including removed ones, have outgrown its capacity.
+			bool NeedsRebuild() const
+			{
+				return _added > _capacity;
+			}
+
+			// Empties the filter and sizes it for twice the count, to be refilled with count keys.
+			void Reset(SizeType count)
+			{
+				_capacity = count * 2 > _minCapacity ? count * 2 : _minCapacity;
+				var blocks = static_cast<SizeType>(1);
+				var bits = static_cast<double>(_capacity) * _bitsPerKey;
+				while (static_cast<double>(blocks * BlockBits) < bits)
+				{
+					blocks <<= 1;
+				}
+				_blockMask = blocks - 1;
+				_words.assign(blocks * BlockWords + BlockWords, 0);
+				_offset = AlignedOffset();
+				_added = 0;
+			}
+
+			void Clear()
+			{
+				fill(_words.begin(), _words.end(), 0);
+				_added = 0;
+			}
+
+			SizeType Capacity() const
+			{
+				return _capacity;
+			}
+
+			// Lookups made and those the filter rejected without the owner searching.
+			UInt64 Lookups() const
+			{
+				return _lookups.Get();
+			}
+
+			UInt64 Rejections() const
+			{
+				return _rejections.Get();
+			}
+
+			double HitRate() const
+			{
+				var lookups = Lookups();
+				return lookups == 0 ? 0 : static_cast<double>(Rejections()) / lookups;
+			}
+
+			void ResetCounters()
+			{
+				_lookups.Reset();
+				_rejections.Reset();
+			}
+
+		private:
+
+			// A statistics counter bumped with relaxed atomics, as lookups run on const owners; a copy takes its current value.
+			class Counter
+			{
+			public:
+				Counter() : _value(0) { }
+
+				Counter(const Counter &other) : _value(other.Get()) { }
+
+				Counter &operator=(const Counter &other)
+				{
+					_value.store(other.Get(), memory_order_relaxed);
+					return *this;
+				}
+
+				void Increment()
+				{
+					_value.fetch_add(1, memory_order_relaxed);
+				}
+
+				UInt64 Get() const
+				{
+					return _value.load(memory_order_relaxed);
+				}
+
+				void Reset()
+				{
+					_value.store(0, memory_order_relaxed);
+				}
+
+			private:
+				atomic<UInt64> _value;
+			};
+
+			static constexpr SizeType BlockWords = 8;					// A 64-byte cache line of words
+			static constexpr UInt32 BlockBits = BlockWords * 64;
+			static constexpr UInt32 BlockMask = BlockBits - 1;
+			static constexpr Int32 MaxHashes = 16;
+
+			SizeType _minCapacity;
+			double _bitsPerKey;
+			THash _hash;
+			Int32 _hashes;
+			SizeType _capacity;
+			SizeType _blockMask;
+			SizeType _offset;
+			SizeType _added;											// Keys added plus keys removed since the last Reset
+			vector<UInt64> _words;
+			mutable Counter _lookups;
+			mutable Counter _rejections;
+
+			// The finalizer of SplitMix64; std::hash of an integer is usually the integer itself.
+			static UInt64 Mix(UInt64 h)
+			{
+				h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+				h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+				return h ^ (h >> 31);
+			}
+
+			// Starts the blocks on a cache line; the extra block of _words covers the offset.
+			SizeType AlignedOffset() const
+			{
+				return (BlockWords - reinterpret_cast<UIntPtr>(_words.data()) / sizeof(UInt64) % BlockWords) % BlockWords;
+			}
+
+			bool Probe(UInt64 hash) const
+			{
+				_lookups.Increment();
+				var h = Mix(hash);
+				var block = Block(h);
+				var a = static_cast<UInt32>(h >> 32);
+				var b = static_cast<UInt32>(h) | 1;
+				for (var i = 0; i < _hashes; ++i, a += b)
+				{
+					if ((block[(a & BlockMask) >> 6] & (UInt64(1) << (a & 63))) == 0)
+					{
+						_rejections.Increment();
+						return false;
+					}
+				}
+				return true;
+			}
+
+			template<typename K>
+			bool MayContainOther(const K &key, true_type) const
+			{
+				return Probe(static_cast<UInt64>(_hash(key)));
+			}
+
+			template<typename K>
+			bool MayContainOther(const K &key, false_type) const
+			{
+				return MayContainConverted(key, is_constructible<TKey, const K &>());
+			}
+
+			template<typename K>
+			bool MayContainConverted(const K &key, true_type) const
+			{
+				return Probe(static_cast<UInt64>(_hash(TKey(key))));
+			}
+
+			template<typename K>
+			bool MayContainConverted(const K &, false_type) const
+			{
+				_lookups.Increment();
+				return true;
+			}
+
+			// The block is chosen by bits the probe positions do not use.
+			UInt64 *Block(UInt64 h)
+			{
+				return &_words[_offset + (static_cast<SizeType>(Mix(h)) & _blockMask) * BlockWords];
+			}
+
+			const UInt64 *Block(UInt64 h) const
+			{
+				return &_words[_offset + (static_cast<SizeType>(Mix(h)) & _blockMask) * BlockWords];
+			}
+		};
+	}
+}
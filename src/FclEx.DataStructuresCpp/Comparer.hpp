@@ -1,7 +1,13 @@
 #pragma once
 
+#include <functional>
+
+#include "Define.h"
+
 namespace FclEx
 {
+	using namespace std;
+
 	struct PtrLessComparer
 	{
 		template<class T>
@@ -18,6 +24,13 @@ namespace FclEx
 		}
 	};
 
+	// Whether the comparer also compares other types, like less<> does; it then declares is_transparent.
+	template <typename T, typename = void>
+	struct IsTransparent : false_type {};
+
+	template <typename T>
+	struct IsTransparent<T, typename conditional<true, void, typename T::is_transparent>::type> : true_type {};
+
 	template <typename T, typename TLessComparer = less<T>>
 	class Comparer
 	{
@@ -28,6 +41,13 @@ namespace FclEx
 			return _less(lhs, rhs);
 		}
 
+		// For a transparent comparer, compares with a value of another type without converting it to T.
+		template <typename TLhs, typename TRhs>
+		bool Less(const TLhs &lhs, const TRhs &rhs) const
+		{
+			return _less(lhs, rhs);
+		}
+
 		bool Equals(const T &lhs, const T &rhs) const
 		{
 			return !_less(lhs, rhs) && !_less(rhs, lhs);
@@ -55,6 +75,6 @@ namespace FclEx
 		}
 
 	private:
-		const TLessComparer _less;
+		const TLessComparer _less{};
 	};
 }
\ No newline at end of file
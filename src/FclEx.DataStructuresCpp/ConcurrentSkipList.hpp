@@ -0,0 +1,711 @@
+#pragma once
+
+#include "Define.h"
+#include "IKeyValueCollection.h"
+#include "Random.hpp"
+#include "SkipListLevel.hpp"
+#include "Comparer.hpp"
+#include "Iterator.hpp"
+#include "EpochManager.hpp"
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include "NonCopyable.hpp"
+
+namespace FclEx
+{
+	namespace Collections
+	{
+		using namespace std;
+		using namespace Node;
+
+		// Node of a ConcurrentSkipList. Like SkipListNode the tower is allocated inline, but every link is
+		// an atomic marked pointer: the low bit set on NeighborNodes[i] means the node is being unlinked at level i.
+		// Each node is one version of its key, alive from InsertVersion up to (excluding) RemoveVersion.
+		template<typename TKey, typename TValue, typename Allocator>
+		class ConcurrentSkipListNode
+		{
+		public:
+
+			typedef Allocator									allocator_type;
+			typedef typename allocator_type::difference_type    difference_type;
+			typedef typename allocator_type::reference          reference;
+			typedef typename allocator_type::const_reference    const_reference;
+			typedef typename allocator_type::pointer            pointer;
+			typedef typename allocator_type::const_pointer      const_pointer;
+			typedef pair<TKey, TValue>							value_type;
+
+			using PNode = ConcurrentSkipListNode*;
+			using ItemType = pair<TKey, TValue>;
+
+			static constexpr UInt64 LiveVersion = numeric_limits<UInt64>::max();		// RemoveVersion of a node that has not been removed
+			static constexpr UInt64 PendingVersion = LiveVersion - 1;					// Version claimed but not numbered yet
+
+			ItemType Item;
+
+			atomic<UInt64> InsertVersion;
+			atomic<UInt64> RemoveVersion;
+
+			template<typename ...Args>
+			static PNode Create(SizeType level, Args&&... args)
+			{
+				if (level <= 0) throw std::invalid_argument("level");
+				ByteAllocator allocator;
+				var memory = allocator.allocate(AllocationSize(level));
+				try
+				{
+					return ::new (static_cast<void*>(memory)) ConcurrentSkipListNode(level, forward<Args>(args)...);
+				}
+				catch (...)
+				{
+					allocator.deallocate(memory, AllocationSize(level));
+					throw;
+				}
+			}
+
+			static void Destroy(PNode node) noexcept
+			{
+				var size = AllocationSize(node->_height);
+				node->~ConcurrentSkipListNode();
+				ByteAllocator().deallocate(reinterpret_cast<char*>(node), size);
+			}
+
+			static void Destroy(void *node) noexcept
+			{
+				Destroy(static_cast<PNode>(node));
+			}
+
+			static PNode GetPointer(UIntPtr link)
+			{
+				return reinterpret_cast<PNode>(link & ~MarkFlag);
+			}
+
+			static bool IsMarked(UIntPtr link)
+			{
+				return (link & MarkFlag) != 0;
+			}
+
+			static UIntPtr MakeLink(PNode node, bool marked = false)
+			{
+				return reinterpret_cast<UIntPtr>(node) | (marked ? MarkFlag : 0);
+			}
+
+			// The window between claiming and numbering a version is a few instructions long.
+			static UInt64 ResolveVersion(const atomic<UInt64> &version)
+			{
+				var value = version.load(memory_order_acquire);
+				while (value == PendingVersion)
+				{
+					this_thread::yield();
+					value = version.load(memory_order_acquire);
+				}
+				return value;
+			}
+
+			ConcurrentSkipListNode(const ConcurrentSkipListNode &) = delete;
+			ConcurrentSkipListNode& operator=(const ConcurrentSkipListNode &) = delete;
+
+			PNode Next() const
+			{
+				return GetPointer(NeighborNodes[0].load(memory_order_acquire));
+			}
+
+			SizeType Height() const
+			{
+				return _height;
+			}
+
+			// Whether this is the current version of its key, as seen by operations that do not use a snapshot.
+			bool IsLive() const
+			{
+				return RemoveVersion.load(memory_order_acquire) == LiveVersion;
+			}
+
+			bool IsVisible(UInt64 version) const
+			{
+				return ResolveVersion(InsertVersion) <= version && version < ResolveVersion(RemoveVersion);
+			}
+
+			// Both the inserting thread and the purging thread hold a reference until they are sure
+			// the node is unlinked from every level; whoever releases last retires the node.
+			bool Release()
+			{
+				return _references.fetch_sub(1, memory_order_acq_rel) == 1;
+			}
+
+		private:
+
+			using ByteAllocator = typename allocator_traits<Allocator>::template rebind_alloc<char>;
+
+			static constexpr UIntPtr MarkFlag = 1;
+
+			atomic<UInt32> _references;
+			UInt32 _height;
+
+		public:
+
+			// Declared with one slot, but Create() allocates room for Height() slots.
+			atomic<UIntPtr> NeighborNodes[1];
+
+		private:
+
+			template<typename ...Args>
+			explicit ConcurrentSkipListNode(SizeType level, Args&&... args) :
+				Item(forward<Args>(args)...),
+				InsertVersion(PendingVersion),
+				RemoveVersion(LiveVersion),
+				_references(2),
+				_height(static_cast<UInt32>(level))
+			{
+				for (SizeType i = 0; i < level; ++i)
+				{
+					::new (static_cast<void*>(&NeighborNodes[i])) atomic<UIntPtr>(0);
+				}
+			}
+
+			~ConcurrentSkipListNode() = default;
+
+			static constexpr SizeType AllocationSize(SizeType level)
+			{
+				return sizeof(ConcurrentSkipListNode) + (level - 1) * sizeof(atomic<UIntPtr>);
+			}
+		};
+
+		// Walks level 0 and stops only at the node versions visible at the snapshot's version.
+		template<typename TKey, typename TValue, typename Allocator>
+		class ConcurrentSkipListSnapshotIterator : public Node::Iterator<ConcurrentSkipListNode<TKey, TValue, Allocator>, ConcurrentSkipListSnapshotIterator<TKey, TValue, Allocator>>
+		{
+		public:
+			using Iterator = Node::Iterator<ConcurrentSkipListNode<TKey, TValue, Allocator>, ConcurrentSkipListSnapshotIterator>;
+			using IteratorType = typename Iterator::self_type;
+			using NodeType = typename Iterator::node_type;
+
+			ConcurrentSkipListSnapshotIterator(NodeType *node, UInt64 version) :Iterator(node), _version(version)
+			{
+				SkipInvisible();
+			}
+
+			IteratorType &operator++() override
+			{
+				Iterator::_pNode = Iterator::_pNode->Next();
+				SkipInvisible();
+				return *this;
+			}
+
+			IteratorType operator++(int) override
+			{
+				IteratorType old(*this);
+				operator++();
+				return old;
+			}
+
+		private:
+			UInt64 _version;
+
+			void SkipInvisible()
+			{
+				while (Iterator::_pNode != nullptr && !Iterator::_pNode->IsVisible(_version))
+				{
+					Iterator::_pNode = Iterator::_pNode->Next();
+				}
+			}
+		};
+
+		// A lock-free skip list (Fraser; Herlihy & Shavit). Nodes are unlinked by marking their forward links
+		// top-down, physically snipped by any thread that meets them during a search, and freed through
+		// epoch based reclamation.
+		// Every insert and remove is numbered. A removed node stays linked as an old version of its key while
+		// a Snapshot may still see it, so snapshots read a consistent point-in-time view while writers carry on.
+		// Versions of the same key are ordered newest first.
+		// All members are safe to call concurrently except the destructor. References returned by
+		// operator[] stay valid only until the key is removed, and writes through them are not versioned.
+		template<typename TKey,
+			typename TValue,
+			typename TLess = less<TKey>,
+			typename Allocator = allocator<pair<TKey, TValue>>>
+			class ConcurrentSkipList : IKeyValueCollection<TKey, TValue>, NonCopyable
+		{
+		public:
+
+			using Node = ConcurrentSkipListNode<TKey, TValue, Allocator>;
+			using PNode = typename Node::PNode;
+			using ItemType = typename Node::ItemType;
+
+			// A point-in-time, read-only view; it must not outlive its list. While a snapshot is alive the
+			// versions it sees are kept and no removed memory is reclaimed, so long-lived snapshots cost memory.
+			// Each snapshot holds an epoch guard, and with it a participant slot of the EpochManager, for its whole life;
+			// the manager adds slots as they run out, so the number of open snapshots is not limited.
+			class Snapshot
+			{
+			public:
+				using Iterator = ConcurrentSkipListSnapshotIterator<TKey, TValue, Allocator>;
+
+				Snapshot(Snapshot &&other) noexcept :
+					_list(other._list),
+					_guard(move(other._guard)),
+					_version(other._version)
+				{
+					other._list = null;
+				}
+
+				Snapshot(const Snapshot &) = delete;
+				Snapshot& operator=(const Snapshot &) = delete;
+				Snapshot& operator=(Snapshot &&) = delete;
+
+				~Snapshot() noexcept
+				{
+					if (_list == null) return;
+					_guard.reset();
+					_list->ReleaseSnapshot(_version);
+				}
+
+				UInt64 Version() const
+				{
+					return _version;
+				}
+
+				Iterator begin() const
+				{
+					return Iterator(_list->_head->Next(), _version);
+				}
+
+				Iterator end() const
+				{
+					return Iterator(null, _version);
+				}
+
+				bool ContainsKey(const TKey& key) const
+				{
+					return _list->Find(key, _version) != null;
+				}
+
+				const TValue& operator[](const TKey& key) const
+				{
+					var node = _list->Find(key, _version);
+					return node == null ? _list->_defaultValue : node->Item.second;
+				}
+
+			private:
+				friend class ConcurrentSkipList;
+
+				ConcurrentSkipList *_list;
+				unique_ptr<EpochManager::Guard> _guard;
+				UInt64 _version;
+
+				Snapshot(ConcurrentSkipList *list, unique_ptr<EpochManager::Guard> guard, UInt64 version) :
+					_list(list),
+					_guard(move(guard)),
+					_version(version)
+				{
+				}
+			};
+
+			ConcurrentSkipList() :
+				_head(Node::Create(MaxLevel)),
+				_listLevel(1),
+				_count(0),
+				_version(0),
+				_oldestSnapshot(Node::LiveVersion),
+				_unpurgedNodes(0)
+			{
+			}
+
+			~ConcurrentSkipList() noexcept
+			{
+				var p = _head;
+				while (p != null)
+				{
+					var q = p;
+					p = q->Next();
+					Node::Destroy(q);
+				}
+			}
+
+			SizeType Count() const override
+			{
+				return _count.load(memory_order_relaxed);
+			}
+
+			void Add(const ItemType &item) override
+			{
+				EpochManager::Guard guard(_epoch);
+				Insert(guard, item);
+			}
+
+			// Removes every element present when the call starts; elements added concurrently may survive.
+			void Clear() override
+			{
+				EpochManager::Guard guard(_epoch);
+				for (var p = _head->Next(); p != null; p = p->Next())
+				{
+					if (p->IsLive()) Remove(guard, p->Item.first, false);
+				}
+			}
+
+			bool Contains(const ItemType &item) const override
+			{
+				EpochManager::Guard guard(_epoch);
+				var node = Find(item.first);
+				return node != null && _valueComparer.Equals(node->Item.second, item.second);
+			}
+
+			bool Remove(const ItemType &item) override
+			{
+				EpochManager::Guard guard(_epoch);
+				return Remove(guard, item.first, true, item.second);
+			}
+
+			//// index-get
+			const TValue& operator[](const TKey& key) const override
+			{
+				EpochManager::Guard guard(_epoch);
+				var node = Find(key);
+				return node == null ? _defaultValue : node->Item.second;
+			}
+
+			//// index-set
+			TValue& operator[](const TKey& key) override
+			{
+				EpochManager::Guard guard(_epoch);
+				return Insert(guard, ItemType(key, default(TValue)))->Item.second;
+			}
+
+			void Add(const TKey& key, const TValue& value) override
+			{
+				Add(ItemType(key, value));
+			}
+
+			bool ContainsKey(const TKey& key) const override
+			{
+				EpochManager::Guard guard(_epoch);
+				return Find(key) != null;
+			}
+
+			bool ContainsValue(const TValue& value) const override
+			{
+				EpochManager::Guard guard(_epoch);
+				for (var p = _head->Next(); p != null; p = p->Next())
+				{
+					if (p->IsLive() && _valueComparer.Equals(p->Item.second, value)) return true;
+				}
+				return false;
+			}
+
+			bool Remove(const TKey& key) override
+			{
+				EpochManager::Guard guard(_epoch);
+				return Remove(guard, key, false);
+			}
+
+			// Copies the value out while the node is still protected, unlike operator[].
+			bool TryGetValue(const TKey& key, TValue &value) const
+			{
+				EpochManager::Guard guard(_epoch);
+				var node = Find(key);
+				if (node == null) return false;
+				value = node->Item.second;
+				return true;
+			}
+
+			// Every insert and remove that completed before this call is visible to the snapshot, none after it is.
+			Snapshot TakeSnapshot()
+			{
+				unique_ptr<EpochManager::Guard> guard(new EpochManager::Guard(_epoch));
+				var version = RegisterSnapshot();
+				return Snapshot(this, move(guard), version);
+			}
+
+		private:
+
+			static constexpr UInt32 MaxLevel = 32;			// Maximum level any node in a skip list can have
+			static constexpr double Probability = 0.5;		// Probability factor used to determine the node level
+			const PNode _head;								// The skip list header.
+
+			atomic<Int32> _listLevel;						// Highest level any node has reached; never lowered.
+			atomic<SizeType> _count;						// Current number of live keys in the skip list.
+			atomic<UInt64> _version;						// Number of the last insert or remove.
+			atomic<UInt64> _oldestSnapshot;					// Version of the oldest live snapshot, LiveVersion if there is none.
+			atomic<SizeType> _unpurgedNodes;				// Removed nodes still linked, most of them kept for a snapshot.
+			mutex _snapshotsMutex;
+			multiset<UInt64> _snapshots;
+			const TValue _defaultValue = default(TValue);
+			const Comparer<TKey, TLess> _comparer;
+			const Comparer<TValue> _valueComparer;
+			mutable EpochManager _epoch;
+
+			static const Random& ThreadRandom()
+			{
+				static thread_local const Random random(static_cast<uint>(hash<thread::id>()(this_thread::get_id()) ^ time(nullptr)));
+				return random;
+			}
+
+			Int32 GetNewLevel() const
+			{
+				return NewLevel(ThreadRandom(), _listLevel.load(memory_order_relaxed), MaxLevel, Probability);
+			}
+
+			// Whether a search for (key, version) must move past node: nodes are ordered by key,
+			// then newest version first. An insert that is not numbered yet is the newest.
+			bool IsBefore(const PNode node, const TKey &key, UInt64 version) const
+			{
+				if (_comparer.Less(node->Item.first, key)) return true;
+				if (_comparer.Less(key, node->Item.first) || version == Node::PendingVersion) return false;
+				return Node::ResolveVersion(node->InsertVersion) > version;
+			}
+
+			// Wait-free lookup of the current version of a key: marked nodes are skipped but not unlinked.
+			PNode Find(const TKey &key) const
+			{
+				var node = Find(key, Node::PendingVersion);
+				return node != null && node->IsLive() ? node : null;
+			}
+
+			// Returns the version of the key visible at version, or the newest one if version is PendingVersion.
+			PNode Find(const TKey &key, UInt64 version) const
+			{
+				var p = _head;
+				PNode next = null;
+				for (var i = _listLevel.load(memory_order_acquire) - 1; i >= 0; --i)
+				{
+					next = Node::GetPointer(p->NeighborNodes[i].load(memory_order_acquire));
+					while (next != null)
+					{
+						var link = next->NeighborNodes[i].load(memory_order_acquire);
+						if (Node::IsMarked(link))
+						{
+							next = Node::GetPointer(link);
+							continue;
+						}
+						if (!IsBefore(next, key, version)) break;
+						p = next; // Move forward in the skip list.
+						next = Node::GetPointer(link);
+					}
+				}
+				if (next == null || _comparer.Less(key, next->Item.first)) return null;
+				if (version == Node::PendingVersion) return next;
+				return next->IsVisible(version) ? next : null;
+			}
+
+			// Fills prevNodes/nextNodes around the position of (key, version) for the lowest `levels` levels and
+			// physically unlinks the marked nodes it meets. Returns whether nextNodes[0] holds the key.
+			bool FindPrevNodes(const TKey &key, UInt64 version, PNode *prevNodes, PNode *nextNodes, Int32 levels) const
+			{
+			retry:
+				var p = _head;
+				for (var i = levels - 1; i >= 0; --i)
+				{
+					var next = Node::GetPointer(p->NeighborNodes[i].load(memory_order_acquire));
+					while (next != null)
+					{
+						var link = next->NeighborNodes[i].load(memory_order_acquire);
+						while (Node::IsMarked(link))
+						{
+							// Snip the marked node; fails if p itself got marked or changed.
+							var expected = Node::MakeLink(next);
+							if (!p->NeighborNodes[i].compare_exchange_strong(expected, Node::MakeLink(Node::GetPointer(link)), memory_order_acq_rel))
+							{
+								goto retry;
+							}
+							next = Node::GetPointer(link);
+							if (next == null) break;
+							link = next->NeighborNodes[i].load(memory_order_acquire);
+						}
+						if (next == null || !IsBefore(next, key, version)) break;
+						p = next; // Move forward in the skip list.
+						next = Node::GetPointer(link);
+					}
+					prevNodes[i] = p;
+					nextNodes[i] = next;
+				}
+				return nextNodes[0] != null && !_comparer.Less(key, nextNodes[0]->Item.first);
+			}
+
+			// Returns the node now holding the key, which is the existing one if the key was already present.
+			PNode Insert(EpochManager::Guard &guard, const ItemType &item)
+			{
+				PNode prevNodes[MaxLevel];
+				PNode nextNodes[MaxLevel];
+				PNode newNode = null;
+				Int32 newLevel = 0;
+
+				for (;;)
+				{
+					if (newNode == null)
+					{
+						newLevel = GetNewLevel(); // Get the level for the new node.
+					}
+					// A new version goes in front of every older version of its key.
+					if (FindPrevNodes(item.first, Node::PendingVersion, prevNodes, nextNodes, SearchLevels(newLevel)))
+					{
+						if (nextNodes[0]->IsLive())
+						{
+							if (newNode != null) Node::Destroy(newNode);
+							return nextNodes[0];
+						}
+						// The old version's removal must be numbered before the new version's insert.
+						Node::ResolveVersion(nextNodes[0]->RemoveVersion);
+					}
+					if (newNode == null)
+					{
+						newNode = Node::Create(newLevel, item);
+					}
+					for (var i = 0; i < newLevel; ++i)
+					{
+						newNode->NeighborNodes[i].store(Node::MakeLink(nextNodes[i]), memory_order_relaxed);
+					}
+					// Linking level 0 is the linearization point of the insert.
+					var expected = Node::MakeLink(nextNodes[0]);
+					if (prevNodes[0]->NeighborNodes[0].compare_exchange_strong(expected, Node::MakeLink(newNode), memory_order_acq_rel))
+					{
+						break;
+					}
+				}
+				var version = _version.fetch_add(1, memory_order_seq_cst) + 1;
+				newNode->InsertVersion.store(version, memory_order_release);
+				_count.fetch_add(1, memory_order_relaxed);
+				RaiseListLevel(newLevel);
+
+				for (var i = 1; i < newLevel; ++i)
+				{
+					for (;;)
+					{
+						// Point the new node at its successor, unless a purge has already marked this level.
+						var link = newNode->NeighborNodes[i].load(memory_order_acquire);
+						if (Node::IsMarked(link)) goto linked;
+						// Only a purge can make this fail, by marking the link.
+						if (Node::GetPointer(link) != nextNodes[i]
+							&& !newNode->NeighborNodes[i].compare_exchange_strong(link, Node::MakeLink(nextNodes[i]), memory_order_acq_rel))
+						{
+							goto linked;
+						}
+						var expected = Node::MakeLink(nextNodes[i]);
+						if (prevNodes[i]->NeighborNodes[i].compare_exchange_strong(expected, Node::MakeLink(newNode), memory_order_acq_rel))
+						{
+							break;
+						}
+						FindPrevNodes(item.first, version, prevNodes, nextNodes, SearchLevels(newLevel));
+						if (nextNodes[0] != newNode) goto linked; // Purged meanwhile.
+					}
+				}
+
+			linked:
+				// A concurrent purge may have unlinked the node before some of its levels were linked.
+				if (Node::IsMarked(newNode->NeighborNodes[0].load(memory_order_acquire)))
+				{
+					FindPrevNodes(item.first, version, prevNodes, nextNodes, SearchLevels(newLevel));
+				}
+				if (newNode->Release()) guard.Retire(newNode, &Node::Destroy);
+				return newNode;
+			}
+
+			bool Remove(EpochManager::Guard &guard, const TKey &key, bool checkValue, const TValue &value = default(TValue))
+			{
+				PNode prevNodes[MaxLevel];
+				PNode nextNodes[MaxLevel];
+				if (!FindPrevNodes(key, Node::PendingVersion, prevNodes, nextNodes, SearchLevels(1))) return false;
+
+				var node = nextNodes[0];
+				if (checkValue && !_valueComparer.Equals(node->Item.second, value)) return false;
+
+				// Claiming RemoveVersion is the linearization point; the insert must be numbered first.
+				Node::ResolveVersion(node->InsertVersion);
+				var expected = Node::LiveVersion;
+				if (!node->RemoveVersion.compare_exchange_strong(expected, Node::PendingVersion, memory_order_acq_rel)) return false;
+				var version = _version.fetch_add(1, memory_order_seq_cst) + 1;
+				node->RemoveVersion.store(version, memory_order_release);
+				_count.fetch_sub(1, memory_order_relaxed);
+				_unpurgedNodes.fetch_add(1, memory_order_relaxed);
+
+				if (version <= _oldestSnapshot.load(memory_order_seq_cst))
+				{
+					Purge(guard, node);
+				}
+				return true;
+			}
+
+			// Physically unlinks a removed node that no snapshot can see any more.
+			bool Purge(EpochManager::Guard &guard, PNode node)
+			{
+				// Mark the upper levels top-down, then race for level 0: whoever marks it owns the unlink.
+				for (var i = static_cast<Int32>(node->Height()) - 1; i >= 1; --i)
+				{
+					var link = node->NeighborNodes[i].load(memory_order_acquire);
+					while (!Node::IsMarked(link))
+					{
+						node->NeighborNodes[i].compare_exchange_weak(link, Node::MakeLink(Node::GetPointer(link), true), memory_order_acq_rel);
+					}
+				}
+				var link = node->NeighborNodes[0].load(memory_order_acquire);
+				for (;;)
+				{
+					if (Node::IsMarked(link)) return false;
+					if (node->NeighborNodes[0].compare_exchange_weak(link, Node::MakeLink(Node::GetPointer(link), true), memory_order_acq_rel)) break;
+				}
+
+				PNode prevNodes[MaxLevel];
+				PNode nextNodes[MaxLevel];
+				var version = node->InsertVersion.load(memory_order_acquire);
+				FindPrevNodes(node->Item.first, version, prevNodes, nextNodes, SearchLevels(static_cast<Int32>(node->Height()))); // Physically unlink the node.
+				_unpurgedNodes.fetch_sub(1, memory_order_relaxed);
+				if (node->Release()) guard.Retire(node, &Node::Destroy);
+				return true;
+			}
+
+			UInt64 RegisterSnapshot()
+			{
+				lock_guard<mutex> lock(_snapshotsMutex);
+				var version = _version.load(memory_order_seq_cst);
+				for (;;)
+				{
+					// Publish before re-reading the version, so a remover numbered after our read
+					// is guaranteed to see us and keep its node linked.
+					_oldestSnapshot.store(_snapshots.empty() || version < *_snapshots.begin() ? version : *_snapshots.begin(), memory_order_seq_cst);
+					var current = _version.load(memory_order_seq_cst);
+					if (current == version) break;
+					version = current;
+				}
+				_snapshots.insert(version);
+				_oldestSnapshot.store(*_snapshots.begin(), memory_order_seq_cst);
+				return version;
+			}
+
+			void ReleaseSnapshot(UInt64 version)
+			{
+				{
+					lock_guard<mutex> lock(_snapshotsMutex);
+					_snapshots.erase(_snapshots.find(version));
+					_oldestSnapshot.store(_snapshots.empty() ? Node::LiveVersion : *_snapshots.begin(), memory_order_seq_cst);
+				}
+				if (_unpurgedNodes.load(memory_order_relaxed) == 0) return;
+
+				// Collect the old versions nobody can see any more.
+				// The bound is re-read after each removal version, as a snapshot may register during the walk.
+				EpochManager::Guard guard(_epoch);
+				for (var p = _head->Next(); p != null; p = p->Next())
+				{
+					var removeVersion = p->RemoveVersion.load(memory_order_seq_cst);
+					if (removeVersion < Node::PendingVersion && removeVersion <= _oldestSnapshot.load(memory_order_seq_cst)) Purge(guard, p);
+				}
+			}
+
+			// A node taller than the current list level may be linked at levels a search from _listLevel would miss.
+			Int32 SearchLevels(Int32 nodeLevel) const
+			{
+				var listLevel = _listLevel.load(memory_order_acquire);
+				return listLevel > nodeLevel ? listLevel : nodeLevel;
+			}
+
+			void RaiseListLevel(Int32 level)
+			{
+				var current = _listLevel.load(memory_order_relaxed);
+				while (current < level && !_listLevel.compare_exchange_weak(current, level, memory_order_acq_rel)) { }
+			}
+		};
+
+	}
+}
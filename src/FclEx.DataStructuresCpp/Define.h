@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 #ifdef _DEBUG
@@ -23,11 +24,35 @@ using UInt16 = uint16_t;
 using UInt32 = uint32_t;
 using UInt64 = uint64_t;
 
+using UIntPtr = uintptr_t;
+
 using SizeType = size_t;
 
+// Files in FclEx are using namespace std, which brings in std::byte in C++17; this declaration is found first.
+namespace FclEx
+{
+	using ::byte;
+}
+
 #define var auto
 #define null nullptr
 
 #define default(type) type{}
 
-#define nameof(v) #v
\ No newline at end of file
+#define nameof(v) #v
+
+// Hints the processor to fetch the cache line at the address; never faults.
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <xmmintrin.h>
+#define PREFETCH(address) _mm_prefetch(reinterpret_cast<const char*>(address), _MM_HINT_T0)
+#elif defined(__GNUC__)
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address) ((void)(address))
+#endif
+
+// std::string_view needs C++17; MSVC reports the language version in _MSVC_LANG.
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <string_view>
+#define FCLEX_HAS_STRING_VIEW
+#endif
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Define.h"
+#include "NonCopyable.hpp"
+
+namespace FclEx
+{
+	using namespace std;
+
+	// Epoch based memory reclamation.
+	// A thread enters a critical section with a Guard before it reads shared pointers, and
+	// hands unlinked memory to Retire instead of freeing it. Retired memory is freed once
+	// the global epoch has advanced twice, i.e. once no guard that could still see it remains.
+	// Every live guard takes a participant slot. The slots come in blocks of BlockParticipants, and a block is added
+	// when all are taken, so any number of guards may be held at once; blocks are only freed with the manager.
+	class EpochManager : NonCopyable
+	{
+		struct Participant;
+
+	public:
+
+		using Deleter = void(*)(void*);
+
+		static constexpr UInt32 BlockParticipants = 128;	// Participant slots added at a time
+
+		class Guard : NonCopyable
+		{
+		public:
+			explicit Guard(EpochManager &manager) : _manager(manager), _participant(manager.Enter()) { }
+
+			~Guard() noexcept
+			{
+				_manager.Exit(*_participant);
+			}
+
+			void Retire(void *pointer, Deleter deleter)
+			{
+				_manager.Retire(*_participant, pointer, deleter);
+			}
+
+		private:
+			EpochManager &_manager;
+			Participant *_participant;
+		};
+
+		EpochManager() : _globalEpoch(EpochStep) { }
+
+		~EpochManager() noexcept
+		{
+			for (var block = &_participants; block != null;)
+			{
+				for (var &participant : block->Participants)
+				{
+					for (var &bag : participant.Bags)
+					{
+						FreeBag(bag);
+					}
+				}
+				var next = block->Next.load(memory_order_acquire);
+				if (block != &_participants) delete block;
+				block = next;
+			}
+		}
+
+		UInt64 GlobalEpoch() const
+		{
+			return _globalEpoch.load(memory_order_acquire) / EpochStep;
+		}
+
+	private:
+
+		static constexpr UInt64 ActiveFlag = 1;			// Low bit of a participant epoch marks an active guard
+		static constexpr UInt64 EpochStep = 2;
+		static constexpr UInt32 BagsNum = 3;
+		static constexpr UInt32 RetiresPerAdvance = 64;	// How many retirements a participant makes before it tries to advance the epoch
+
+		struct Retired
+		{
+			void *Pointer;
+			Deleter Delete;
+		};
+
+		struct Bag
+		{
+			UInt64 Epoch = 0;
+			vector<Retired> Items;
+		};
+
+		struct alignas(64) Participant
+		{
+			atomic<bool> InUse{ false };
+			atomic<UInt64> Epoch{ 0 };
+			UInt32 RetiresSinceAdvance = 0;
+			Bag Bags[BagsNum];
+		};
+
+		struct ParticipantBlock
+		{
+			Participant Participants[BlockParticipants];
+			atomic<ParticipantBlock*> Next{ null };
+
+			// Before C++17 new ignores the cache line alignment of the participants, so added blocks are aligned here;
+			// the address to free is kept in front of the block.
+			static void *operator new(size_t size)
+			{
+				var raw = static_cast<char*>(::operator new(size + sizeof(void*) + alignof(ParticipantBlock) - 1));
+				var address = (reinterpret_cast<UIntPtr>(raw) + sizeof(void*) + alignof(ParticipantBlock) - 1) & ~static_cast<UIntPtr>(alignof(ParticipantBlock) - 1);
+				var block = reinterpret_cast<void**>(address);
+				block[-1] = raw;
+				return block;
+			}
+
+			static void operator delete(void *block)
+			{
+				if (block != null) ::operator delete(static_cast<void**>(block)[-1]);
+			}
+		};
+
+		atomic<UInt64> _globalEpoch;
+		ParticipantBlock _participants;						// The first block, followed by any added ones
+
+		Participant *Enter()
+		{
+			var &participant = Acquire();
+			var epoch = _globalEpoch.load(memory_order_seq_cst);
+			for (;;)
+			{
+				// The announcement must be visible before any shared pointer is read, and must not be stale:
+				// the epoch may have advanced past us while we were not yet announced.
+				participant.Epoch.store(epoch | ActiveFlag, memory_order_seq_cst);
+				var current = _globalEpoch.load(memory_order_seq_cst);
+				if (current == epoch) break;
+				epoch = current;
+			}
+
+			// Everything retired two epochs ago can no longer be referenced by anyone.
+			for (var &bag : participant.Bags)
+			{
+				if (bag.Epoch + 2 * EpochStep <= epoch) FreeBag(bag);
+			}
+			return &participant;
+		}
+
+		// Takes a free participant slot, starting in each block at a slot picked by the thread id,
+		// and appends a new block when every slot is taken.
+		Participant &Acquire()
+		{
+			var start = static_cast<UInt32>(hash<thread::id>()(this_thread::get_id()) % BlockParticipants);
+			for (var block = &_participants;;)
+			{
+				for (UInt32 i = 0; i < BlockParticipants; ++i)
+				{
+					var &participant = block->Participants[(start + i) % BlockParticipants];
+					var expected = false;
+					if (!participant.InUse.load(memory_order_relaxed)
+						&& participant.InUse.compare_exchange_strong(expected, true, memory_order_acquire))
+					{
+						return participant;
+					}
+				}
+
+				var next = block->Next.load(memory_order_acquire);
+				if (next == null)
+				{
+					unique_ptr<ParticipantBlock> added(new ParticipantBlock());
+					// The new block starts out taken by this thread.
+					added->Participants[start].InUse.store(true, memory_order_relaxed);
+					if (block->Next.compare_exchange_strong(next, added.get(), memory_order_seq_cst))
+					{
+						return added.release()->Participants[start];
+					}
+					// Another thread added a block first; next is now that block.
+				}
+				block = next;
+			}
+		}
+
+		void Exit(Participant &participant) noexcept
+		{
+			participant.Epoch.store(participant.Epoch.load(memory_order_relaxed) & ~ActiveFlag, memory_order_release);
+			participant.InUse.store(false, memory_order_release);
+		}
+
+		void Retire(Participant &participant, void *pointer, Deleter deleter)
+		{
+			// Tag with the global epoch read after the unlink, not the participant's own epoch: the global
+			// epoch may already be one ahead, and a guard entered there could still see the pointer.
+			var epoch = _globalEpoch.load(memory_order_seq_cst);
+			var &bag = participant.Bags[(epoch / EpochStep) % BagsNum];
+			if (bag.Epoch != epoch)
+			{
+				// The bag still holds items from an epoch at least three epochs back, which nobody can see any more.
+				FreeBag(bag);
+				bag.Epoch = epoch;
+			}
+			bag.Items.push_back(Retired{ pointer, deleter });
+
+			if (++participant.RetiresSinceAdvance >= RetiresPerAdvance)
+			{
+				participant.RetiresSinceAdvance = 0;
+				TryAdvance();
+			}
+		}
+
+		void TryAdvance()
+		{
+			var epoch = _globalEpoch.load(memory_order_seq_cst);
+			// A block appended after this scan only holds guards announced in the current epoch or later.
+			for (var block = &_participants; block != null; block = block->Next.load(memory_order_seq_cst))
+			{
+				for (var &participant : block->Participants)
+				{
+					var local = participant.Epoch.load(memory_order_seq_cst);
+					if ((local & ActiveFlag) != 0 && (local & ~ActiveFlag) != epoch) return;
+				}
+			}
+			_globalEpoch.compare_exchange_strong(epoch, epoch + EpochStep, memory_order_seq_cst);
+		}
+
+		static void FreeBag(Bag &bag) noexcept
+		{
+			for (var &item : bag.Items)
+			{
+				item.Delete(item.Pointer);
+			}
+			bag.Items.clear();
+		}
+	};
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include "Define.h"
+#include "Comparer.hpp"
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace FclEx
+{
+	namespace Collections
+	{
+		using namespace std;
+
+		// Iterates a FrozenSkipList in key order, walking its implicit tree in order.
+		// As in SmallSkipListIterator, an element is a pair of references since the keys and values are stored apart.
+		template<typename TKey, typename TValue>
+		class FrozenSkipListIterator
+		{
+		public:
+			typedef forward_iterator_tag				iterator_category;
+			typedef pair<TKey, TValue>					value_type;
+			typedef ptrdiff_t							difference_type;
+			typedef pair<const TKey&, const TValue&>	reference;
+
+			// Lets it->second work on the pair of references.
+			class pointer
+			{
+			public:
+				explicit pointer(reference item) : _item(item) { }
+
+				reference *operator->()
+				{
+					return &_item;
+				}
+
+			private:
+				reference _item;
+			};
+
+			// Index 0 is end().
+			FrozenSkipListIterator(const TKey *keys, const TValue *values, SizeType count, SizeType index) :
+				_keys(keys), _values(values), _count(count), _index(index) { }
+
+			const TKey &Key() const
+			{
+				return _keys[_index];
+			}
+
+			const TValue &Value() const
+			{
+				return _values[_index];
+			}
+
+			reference operator*() const
+			{
+				return reference(Key(), Value());
+			}
+
+			pointer operator->() const
+			{
+				return pointer(operator*());
+			}
+
+			// The index after the index in key order, in a tree of count keys: the leftmost node of the right subtree,
+			// or else the first ancestor reached from its left child. The last index is followed by 0.
+			static SizeType Successor(SizeType index, SizeType count)
+			{
+				if (index * 2 + 1 <= count)
+				{
+					index = index * 2 + 1;
+					while (index * 2 <= count)
+					{
+						index *= 2;
+					}
+					return index;
+				}
+				while ((index & 1) != 0)
+				{
+					index >>= 1;
+				}
+				return index >> 1;
+			}
+
+			FrozenSkipListIterator &operator++()
+			{
+				_index = Successor(_index, _count);
+				return *this;
+			}
+
+			FrozenSkipListIterator operator++(int)
+			{
+				FrozenSkipListIterator old(*this);
+				operator++();
+				return old;
+			}
+
+			bool operator==(const FrozenSkipListIterator &other) const
+			{
+				return _keys == other._keys && _index == other._index;
+			}
+
+			bool operator!=(const FrozenSkipListIterator &other) const
+			{
+				return !operator==(other);
+			}
+
+		private:
+			const TKey *_keys;
+			const TValue *_values;
+			SizeType _count;
+			SizeType _index;
+		};
+
+		// A read-only copy of a sorted map for lookups only, see SkipList::Freeze. The keys are stored in Eytzinger order:
+		// the implicit binary tree with the children of index i at 2i and 2i + 1, laid out breadth first from index 1.
+		// A search reads the top levels from the same few cache lines every time, steps down without a branch on the comparison,
+		// and prefetches the line holding the descendants four levels below, so its misses overlap.
+		// The values lie in a parallel array at the same indexes; index 0 of it holds the default value.
+		// Elements take sizeof(TKey) + sizeof(TValue) each, with no node header or tower.
+		template<typename TKey, typename TValue, typename TLess = less<TKey>>
+		class FrozenSkipList
+		{
+		public:
+
+			using Iterator = FrozenSkipListIterator<TKey, TValue>;
+
+			FrozenSkipList() : _keys(1), _values(1, default(TValue)) { }
+
+			// Copies count elements of a range sorted by key; throws invalid_argument if the range is not sorted.
+			template<typename InputIterator>
+			FrozenSkipList(InputIterator first, InputIterator last, SizeType count) :
+				_keys(count + 1),
+				_values(count + 1, default(TValue))
+			{
+				// The sorted elements fill the tree in order.
+				SizeType previous = 0;
+				for (var index = First(); index != 0; index = Iterator::Successor(index, count), ++first)
+				{
+					if (first == last) throw invalid_argument("count");
+					_keys[index] = first->first;
+					_values[index] = first->second;
+					if (previous != 0 && !_comparer.Less(_keys[previous], _keys[index])) throw invalid_argument("first");
+					previous = index;
+				}
+			}
+
+			SizeType Count() const
+			{
+				return _keys.size() - 1;
+			}
+
+			Iterator begin() const
+			{
+				return Iterator(_keys.data(), _values.data(), Count(), First());
+			}
+
+			Iterator end() const
+			{
+				return Iterator(_keys.data(), _values.data(), Count(), 0);
+			}
+
+			// The element with the key, or end().
+			Iterator Find(const TKey &key) const
+			{
+				return Iterator(_keys.data(), _values.data(), Count(), IndexOf(key));
+			}
+
+			// The first element whose key is not less than the key.
+			Iterator lower_bound(const TKey &key) const
+			{
+				return Iterator(_keys.data(), _values.data(), Count(), LowerBound(key));
+			}
+
+			bool ContainsKey(const TKey &key) const
+			{
+				return IndexOf(key) != 0;
+			}
+
+			// The value of the key, or the default value.
+			const TValue &operator[](const TKey &key) const
+			{
+				return _values[IndexOf(key)];
+			}
+
+		private:
+
+			// Prefetching 64 bytes of keys at index i * PrefetchStride covers the descendants four levels down when 16 keys fit in a line.
+			static constexpr SizeType PrefetchStride = 16;
+
+			vector<TKey> _keys;							// Index 0 is unused
+			vector<TValue> _values;						// Index 0 holds the default value
+			Comparer<TKey, TLess> _comparer;
+
+			// The index of the smallest key, or 0.
+			SizeType First() const
+			{
+				SizeType index = Count() == 0 ? 0 : 1;
+				while (index != 0 && index * 2 <= Count())
+				{
+					index *= 2;
+				}
+				return index;
+			}
+
+			// The index of the first key not less than the key, or 0. Each step goes to the right child if the key is greater,
+			// remembering the last node it went left at, which is the answer once the search falls off the tree.
+			SizeType LowerBound(const TKey &key) const
+			{
+				var keys = _keys.data();
+				var count = Count();
+				SizeType index = 1;
+				SizeType bound = 0;
+				while (index <= count)
+				{
+					if (index * PrefetchStride <= count) PREFETCH(keys + index * PrefetchStride);
+					var less = _comparer.Less(keys[index], key);
+					bound = less ? bound : index;
+					index = index * 2 + (less ? 1 : 0);
+				}
+				return bound;
+			}
+
+			SizeType IndexOf(const TKey &key) const
+			{
+				var index = LowerBound(key);
+				return index != 0 && !_comparer.Less(key, _keys[index]) ? index : 0;
+			}
+		};
+	}
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "Define.h"
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace FclEx
+{
+	namespace Collections
+	{
+		using namespace std;
+
+		// A secondary index from values to the keys holding them, for a SkipList to answer ContainsValue in O(1)
+		// and FindByValue in O(k); removing an element costs O(k) too, for k keys holding its value. The owner reports
+		// every element added and removed. A value handed out by reference is reported by Changing:
+		// the index then keeps its old value until the next update, when it reads the value again.
+		// Lookups account for that value without updating the index, so concurrent readers of a const owner are safe.
+		// Keys and values live in the owner's nodes, which keep them in place, so the index refers to keys by address.
+		template<typename TKey, typename TValue, typename THash = hash<TValue>, typename TEqual = equal_to<TValue>>
+		class HashValueIndex
+		{
+		public:
+
+			static constexpr bool Enabled = true;
+
+			HashValueIndex() : _pendingKey(null), _pending(null) { }
+
+			void Added(const TKey &key, const TValue &value)
+			{
+				Sync();
+				_entries.emplace(value, &key);
+			}
+
+			void Removed(const TKey &key, const TValue &value)
+			{
+				if (&value == _pending)
+				{
+					// The value may differ from the indexed one by now.
+					_pending = null;
+					Erase(key, _pendingValue);
+					return;
+				}
+				Sync();
+				Erase(key, value);
+			}
+
+			// The value may be changed through a reference until the next call.
+			void Changing(const TKey &key, const TValue &value)
+			{
+				if (&value == _pending) return;
+				Sync();
+				_pendingKey = &key;
+				_pending = &value;
+				_pendingValue = value;
+			}
+
+			void Clear()
+			{
+				_entries.clear();
+				_pending = null;
+			}
+
+			bool Contains(const TValue &value) const
+			{
+				if (!IsStale()) return _entries.find(value) != _entries.end();
+				if (TEqual()(*_pending, value)) return true;
+				var range = _entries.equal_range(value);
+				for (var it = range.first; it != range.second; ++it)
+				{
+					if (!IsPendingEntry(*it)) return true;
+				}
+				return false;
+			}
+
+			// Appends the keys holding the value to keys, in no particular order.
+			void KeysOf(const TValue &value, vector<TKey> &keys) const
+			{
+				var stale = IsStale();
+				var range = _entries.equal_range(value);
+				for (var it = range.first; it != range.second; ++it)
+				{
+					if (!stale || !IsPendingEntry(*it)) keys.push_back(*it->second);
+				}
+				if (stale && TEqual()(*_pending, value)) keys.push_back(*_pendingKey);
+			}
+
+		private:
+
+			unordered_multimap<TValue, const TKey*, THash, TEqual> _entries;
+			const TKey *_pendingKey;
+			const TValue *_pending;					// The value handed out by Changing, or null
+			TValue _pendingValue;					// Its value when handed out, as indexed
+
+			// Whether the value handed out has changed since, so its entry in the index is out of date.
+			bool IsStale() const
+			{
+				return _pending != null && !TEqual()(*_pending, _pendingValue);
+			}
+
+			// Whether the entry is the one indexed for the value handed out.
+			bool IsPendingEntry(const pair<const TValue, const TKey*> &entry) const
+			{
+				return entry.second == _pendingKey && TEqual()(entry.first, _pendingValue);
+			}
+
+			void Sync()
+			{
+				if (_pending == null) return;
+				if (!TEqual()(*_pending, _pendingValue))
+				{
+					Erase(*_pendingKey, _pendingValue);
+					_entries.emplace(*_pending, _pendingKey);
+				}
+				_pending = null;
+			}
+
+			void Erase(const TKey &key, const TValue &value)
+			{
+				var range = _entries.equal_range(value);
+				for (var it = range.first; it != range.second; ++it)
+				{
+					if (it->second == &key)
+					{
+						_entries.erase(it);
+						return;
+					}
+				}
+			}
+		};
+	}
+}
@@ -133,7 +133,7 @@ namespace FclEx
 					array<uint, MaxLength> freqArray = {0};
 
 					auto it = datas.begin();
-					auto byteLen = BitConverter::BytesTo<uint>(it._Ptr);
+					auto byteLen = BitConverter::BytesTo<uint>(&*it);
 					it += 4;
 					for (size_t i = 0; i < byteLen; ++i)
 					{
@@ -142,22 +142,22 @@ namespace FclEx
 						freqArray[itemIndex] = freq;
 					}
 
-					auto ushortLen = BitConverter::BytesTo<uint>(it._Ptr);
+					auto ushortLen = BitConverter::BytesTo<uint>(&*it);
 					it += 4;
 					for (size_t i = 0; i < ushortLen; ++i)
 					{
 						auto itemIndex = *it++;
-						auto freq = BitConverter::BytesTo<ushort>(it._Ptr);
+						auto freq = BitConverter::BytesTo<ushort>(&*it);
 						it += 2;
 						freqArray[itemIndex] = freq;
 					}
 
-					auto intLen = BitConverter::BytesTo<uint>(it._Ptr);
+					auto intLen = BitConverter::BytesTo<uint>(&*it);
 					it += 4;
 					for (size_t i = 0; i < intLen; ++i)
 					{
 						auto itemIndex = *it++;
-						auto freq = BitConverter::BytesTo<uint>(it._Ptr);
+						auto freq = BitConverter::BytesTo<uint>(&*it);
 						it += 4;
 						freqArray[itemIndex] = freq;
 					}
@@ -169,9 +169,9 @@ namespace FclEx
 				{
 					auto it = datas.begin();
 
-					auto headerLength = BitConverter::BytesTo<uint>(it._Ptr);
+					auto headerLength = BitConverter::BytesTo<uint>(&*it);
 					it += sizeof(uint);
-					auto dataLength = BitConverter::BytesTo<uint>(it._Ptr);
+					auto dataLength = BitConverter::BytesTo<uint>(&*it);
 					it += sizeof(uint);
 
 					const auto headerEndIt = datas.begin() + headerLength;
@@ -8,7 +8,7 @@ namespace FclEx
 	namespace Collections
 	{
 		template<typename TKey, typename TValue>
-		class IKeyValueCollection : public ICollection<pair<TKey, TValue>>
+		class IKeyValueCollection : public ICollection<std::pair<TKey, TValue>>
 		{
 		public:
 			virtual const TValue& operator[](const TKey& key) const = 0;
@@ -0,0 +1,508 @@
+#pragma once
+
+#include "Define.h"
+#include "ICollection.h"
+#include "Random.hpp"
+#include "SkipListLevel.hpp"
+#include "Comparer.hpp"
+#include "Iterator.hpp"
+#include "Monoid.hpp"
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include "NonCopyable.hpp"
+
+namespace FclEx
+{
+	namespace Collections
+	{
+		using namespace std;
+		using namespace Node;
+
+		// Like SkipListNode, but every link of the tower also records its width, i.e. how many level 0 steps it spans,
+		// and the monoid aggregate of the values it spans.
+		template<typename TKey, typename TValue, typename TMonoid, typename Allocator>
+		class IndexableSkipListNode
+		{
+		public:
+
+			typedef Allocator									allocator_type;
+			typedef typename allocator_type::difference_type    difference_type;
+			typedef typename allocator_type::reference          reference;
+			typedef typename allocator_type::const_reference    const_reference;
+			typedef typename allocator_type::pointer            pointer;
+			typedef typename allocator_type::const_pointer      const_pointer;
+			typedef pair<TKey, TValue>							value_type;
+
+			using PNode = IndexableSkipListNode*;
+			using ItemType = pair<TKey, TValue>;
+			using AggregateType = typename TMonoid::ValueType;
+
+			struct Link
+			{
+				PNode Next;
+				SizeType Width;					// Number of level 0 steps from this node to Next
+				AggregateType Aggregate;		// The values of the nodes after this one, up to and including Next
+			};
+
+			ItemType Item;
+
+			template<typename ...Args>
+			static PNode Create(SizeType level, Args&&... args)
+			{
+				if (level <= 0) throw std::invalid_argument("level");
+				ByteAllocator allocator;
+				var memory = allocator.allocate(AllocationSize(level));
+				try
+				{
+					return ::new (static_cast<void*>(memory)) IndexableSkipListNode(level, forward<Args>(args)...);
+				}
+				catch (...)
+				{
+					allocator.deallocate(memory, AllocationSize(level));
+					throw;
+				}
+			}
+
+			static void Destroy(PNode node) noexcept
+			{
+				var size = AllocationSize(node->_height);
+				node->~IndexableSkipListNode();
+				ByteAllocator().deallocate(reinterpret_cast<char*>(node), size);
+			}
+
+			IndexableSkipListNode(const IndexableSkipListNode &) = delete;
+			IndexableSkipListNode& operator=(const IndexableSkipListNode &) = delete;
+
+			PNode Next() const
+			{
+				return Links[0].Next;
+			}
+
+			SizeType Height() const
+			{
+				return _height;
+			}
+
+		private:
+
+			using ByteAllocator = typename allocator_traits<Allocator>::template rebind_alloc<char>;
+
+			UInt32 _height;
+
+		public:
+
+			// Declared with one slot, but Create() allocates room for Height() slots.
+			Link Links[1];
+
+		private:
+
+			template<typename ...Args>
+			explicit IndexableSkipListNode(SizeType level, Args&&... args) :
+				Item(forward<Args>(args)...),
+				_height(static_cast<UInt32>(level))
+			{
+				Links[0] = Link{ nullptr, 1, TMonoid::Identity() };
+				for (SizeType i = 1; i < level; ++i)
+				{
+					::new (static_cast<void*>(&Links[i])) Link{ nullptr, 1, TMonoid::Identity() };
+				}
+			}
+
+			~IndexableSkipListNode()
+			{
+				for (SizeType i = 1; i < _height; ++i)
+				{
+					Links[i].~Link();
+				}
+			}
+
+			static constexpr SizeType AllocationSize(SizeType level)
+			{
+				return sizeof(IndexableSkipListNode) + (level - 1) * sizeof(Link);
+			}
+		};
+
+		template<typename TKey, typename TValue, typename TMonoid, typename Allocator>
+		class IndexableSkipListIterator : public Node::Iterator<IndexableSkipListNode<TKey, TValue, TMonoid, Allocator>, IndexableSkipListIterator<TKey, TValue, TMonoid, Allocator>>
+		{
+		public:
+			using Iterator = Node::Iterator<IndexableSkipListNode<TKey, TValue, TMonoid, Allocator>, IndexableSkipListIterator>;
+			using IteratorType = typename Iterator::self_type;
+			using NodeType = typename Iterator::node_type;
+
+			IndexableSkipListIterator(NodeType *node) :Iterator(node) { }
+
+			IteratorType &operator++() override
+			{
+				Iterator::_pNode = Iterator::_pNode->Next();
+				return *this;
+			}
+
+			IteratorType operator++(int) override
+			{
+				IteratorType old(*this);
+				Iterator::_pNode = Iterator::_pNode->Next();
+				return old;
+			}
+		};
+
+		// A skip list that answers rank, select, range count and range aggregate queries in O(log n).
+		// Each link keeps its width and the TMonoid aggregate of the values it spans, which every update
+		// recomputes bottom-up along its search path. Values must therefore be changed with Set, not through iterators.
+		template<typename TKey,
+			typename TValue,
+			typename TMonoid = NullMonoid,
+			typename TLess = less<TKey>,
+			typename Allocator = allocator<pair<TKey, TValue>>>
+			class IndexableSkipList : ICollection<pair<TKey, TValue>>, NonCopyable
+		{
+		public:
+
+			using Node = IndexableSkipListNode<TKey, TValue, TMonoid, Allocator>;
+			using PNode = typename Node::PNode;
+			using ItemType = typename Node::ItemType;
+			using AggregateType = typename Node::AggregateType;
+			using Iterator = IndexableSkipListIterator<TKey, TValue, TMonoid, Allocator>;
+
+			Iterator begin() const
+			{
+				return Iterator(_head->Next());
+			}
+
+			Iterator end() const
+			{
+				return Iterator(_nil);
+			}
+
+			IndexableSkipList() :
+				_head(Node::Create(MaxLevel)),
+				_nil(null)
+			{
+				Initialize();
+			}
+
+			~IndexableSkipList() noexcept
+			{
+				var p = _head;
+				while (p != _nil)
+				{
+					var q = p;
+					p = p->Next();
+					Node::Destroy(q);
+				}
+			}
+
+			SizeType Count() const override
+			{
+				return _count;
+			}
+
+			void Add(const ItemType &item) override
+			{
+				PNode prevNodes[MaxLevel];
+				if (!FindPrevNodes(item.first, prevNodes))
+				{
+					Insert(item, prevNodes);
+				}
+			}
+
+			void Add(const TKey& key, const TValue& value)
+			{
+				Add(ItemType(key, value));
+			}
+
+			// Sets the value of the key, adding it if it does not exist. Returns whether it was added.
+			bool Set(const TKey& key, const TValue& value)
+			{
+				PNode prevNodes[MaxLevel];
+				if (!FindPrevNodes(key, prevNodes))
+				{
+					Insert(ItemType(key, value), prevNodes);
+					return true;
+				}
+				prevNodes[0]->Next()->Item.second = value;
+				Update(prevNodes);
+				return false;
+			}
+
+			void Clear() override
+			{
+				var p = _head->Next();
+				while (p != _nil)
+				{
+					var q = p;
+					p = p->Next();
+					Node::Destroy(q);
+				}
+				Initialize();
+			}
+
+			bool Contains(const ItemType &item) const override
+			{
+				var node = Find(item.first);
+				return node != null && _valueComparer.Equals(node->Item.second, item.second);
+			}
+
+			bool Remove(const ItemType &item) override
+			{
+				return Remove(item.first, true, item.second);
+			}
+
+			bool Remove(const TKey& key)
+			{
+				return Remove(key, false);
+			}
+
+			bool ContainsKey(const TKey& key) const
+			{
+				return Find(key) != null;
+			}
+
+			const TValue& operator[](const TKey& key) const
+			{
+				var node = Find(key);
+				return node == null ? _defaultValue : node->Item.second;
+			}
+
+			// The number of keys less than the key, i.e. the index the key has or would have.
+			SizeType Rank(const TKey &key) const
+			{
+				SizeType rank = 0;
+				var p = _head;
+				for (var i = _listLevel - 1; i >= 0; --i)
+				{
+					var next = p->Links[i].Next;
+					while (next != _nil && _comparer.Less(next->Item.first, key))
+					{
+						rank += p->Links[i].Width;
+						p = next;
+						next = p->Links[i].Next;
+					}
+				}
+				return rank;
+			}
+
+			// The element at the index in key order, or end() if the index is out of range.
+			Iterator Select(SizeType index) const
+			{
+				if (index >= _count) return end();
+
+				// The head has rank 0, so the element sits at rank index + 1.
+				var target = index + 1;
+				SizeType rank = 0;
+				var p = _head;
+				for (var i = _listLevel - 1; i >= 0; --i)
+				{
+					while (p->Links[i].Next != _nil && rank + p->Links[i].Width <= target)
+					{
+						rank += p->Links[i].Width;
+						p = p->Links[i].Next;
+					}
+				}
+				return Iterator(p);
+			}
+
+			// The number of keys in [lo, hi).
+			SizeType CountRange(const TKey &lo, const TKey &hi) const
+			{
+				return _comparer.Less(lo, hi) ? Rank(hi) - Rank(lo) : 0;
+			}
+
+			// The aggregate of the values of the keys in [lo, hi), combined in key order.
+			AggregateType Aggregate(const TKey &lo, const TKey &hi) const
+			{
+				var result = TMonoid::Identity();
+				if (!_comparer.Less(lo, hi)) return result;
+
+				var p = _head;
+				for (var i = _listLevel - 1; i >= 0; --i)
+				{
+					var next = p->Links[i].Next;
+					while (next != _nil && _comparer.Less(next->Item.first, lo))
+					{
+						p = next;
+						next = p->Links[i].Next;
+					}
+				}
+
+				// From the last node before lo, climb the towers met on the way while their links end before hi,
+				// then come down again; every link taken adds the aggregate it spans.
+				var level = 0;
+				for (;;)
+				{
+					if (level + 1 < _listLevel && level + 1 < static_cast<Int32>(p->Height()))
+					{
+						var up = p->Links[level + 1].Next;
+						if (up != _nil && _comparer.Less(up->Item.first, hi))
+						{
+							++level;
+							continue;
+						}
+					}
+					var next = p->Links[level].Next;
+					if (next == _nil || !_comparer.Less(next->Item.first, hi)) break;
+					result = TMonoid::Combine(result, p->Links[level].Aggregate);
+					p = next;
+				}
+				for (var i = level - 1; i >= 0; --i)
+				{
+					var next = p->Links[i].Next;
+					while (next != _nil && _comparer.Less(next->Item.first, hi))
+					{
+						result = TMonoid::Combine(result, p->Links[i].Aggregate);
+						p = next;
+						next = p->Links[i].Next;
+					}
+				}
+				return result;
+			}
+
+		private:
+
+			static constexpr UInt32 MaxLevel = 32;			// Maximum level any node in a skip list can have
+			static constexpr double Probability = 0.5;		// Probability factor used to determine the node level
+			const PNode _head;								// The skip list header.
+			const PNode _nil;								//  NIL node.
+
+			Int32 _listLevel;								// Current maximum list level.
+			UInt32 _count;									// Current number of elements in the skip list.
+			const TValue _defaultValue = default(TValue);
+			const Comparer<TKey, TLess> _comparer;
+			const Comparer<TValue> _valueComparer;
+			const Random _random;
+
+			Int32 GetNewLevel() const
+			{
+				return NewLevel(_random, _listLevel, MaxLevel, Probability);
+			}
+
+			PNode Find(const TKey &key) const
+			{
+				var p = _head;
+				for (var i = _listLevel - 1; i >= 0; --i)
+				{
+					var next = p->Links[i].Next;
+					while (next != _nil && _comparer.Less(next->Item.first, key))
+					{
+						p = next; // Move forward in the skip list.
+						next = p->Links[i].Next;
+					}
+					if (next != _nil && _comparer.Equals(next->Item.first, key)) return next;
+				}
+				return null;
+			}
+
+			// Fills prevNodes with the nodes before the key at every level and returns whether the key exists.
+			bool FindPrevNodes(const TKey &key, PNode *prevNodes) const
+			{
+				var p = _head;
+				for (var i = _listLevel - 1; i >= 0; i--)
+				{
+					var next = p->Links[i].Next;
+					while (next != _nil && _comparer.Less(next->Item.first, key))
+					{
+						p = next; // Move forward in the skip list.
+						next = p->Links[i].Next;
+					}
+					prevNodes[i] = p;
+				}
+				var next = prevNodes[0]->Next();
+				return next != _nil && _comparer.Equals(next->Item.first, key);
+			}
+
+			PNode Insert(const ItemType &item, PNode *prevNodes)
+			{
+				var newLevel = GetNewLevel(); // Get the level for the new node.
+				var newNode = Node::Create(newLevel, item);
+				if (newLevel > _listLevel)
+				{
+					// Make sure our update references above the current skip list level point to the header.
+					for (var i = _listLevel; i < newLevel; ++i)
+					{
+						prevNodes[i] = _head;
+					}
+					_listLevel = newLevel; // The current skip list level is now the new node level.
+				}
+				for (var i = 0; i < newLevel; ++i)
+				{
+					newNode->Links[i].Next = prevNodes[i]->Links[i].Next;
+					prevNodes[i]->Links[i].Next = newNode;
+				}
+				++_count;
+
+				for (var i = 0; i < _listLevel; ++i)
+				{
+					if (i < newLevel) Recompute(newNode, i);
+					Recompute(prevNodes[i], i);
+				}
+				return newNode;
+			}
+
+			bool Remove(const TKey &key, bool checkValue, const TValue &value = default(TValue))
+			{
+				PNode prevNodes[MaxLevel];
+				if (!FindPrevNodes(key, prevNodes)) return false;
+
+				var node = prevNodes[0]->Next();
+				if (checkValue && !_valueComparer.Equals(node->Item.second, value)) return false;
+
+				for (var i = 0; i < static_cast<Int32>(node->Height()); i++)
+				{
+					prevNodes[i]->Links[i].Next = node->Links[i].Next;
+				}
+				Node::Destroy(node);
+				--_count;
+
+				// After removing the node, we may need to lower the current skip list level if the node had the highest level of all of the nodes.
+				while (_listLevel > 1 && _head->Links[_listLevel - 1].Next == _nil)
+				{
+					--_listLevel;
+				}
+				Update(prevNodes);
+				return true;
+			}
+
+			// Recomputes the links of the search path after the nodes below it changed.
+			void Update(PNode *prevNodes)
+			{
+				for (var i = 0; i < _listLevel; ++i)
+				{
+					Recompute(prevNodes[i], i);
+				}
+			}
+
+			// Recomputes the width and aggregate of a link from the links one level down, which must be up to date.
+			void Recompute(PNode node, Int32 level)
+			{
+				var &link = node->Links[level];
+				if (level == 0)
+				{
+					link.Width = 1;
+					link.Aggregate = link.Next == _nil ? TMonoid::Identity() : TMonoid::Lift(link.Next->Item.second);
+					return;
+				}
+
+				SizeType width = 0;
+				var aggregate = TMonoid::Identity();
+				for (var p = node; p != link.Next; p = p->Links[level - 1].Next)
+				{
+					width += p->Links[level - 1].Width;
+					aggregate = TMonoid::Combine(aggregate, p->Links[level - 1].Aggregate);
+				}
+				link.Width = width;
+				link.Aggregate = aggregate;
+			}
+
+			void Initialize()
+			{
+				for (decltype(_head->Height()) i = 0; i < _head->Height(); ++i)
+				{
+					_head->Links[i] = typename Node::Link{ _nil, 1, TMonoid::Identity() };
+				}
+				_listLevel = 1;
+				_count = 0;
+			}
+		};
+	}
+}
@@ -18,13 +18,12 @@ namespace FclEx
 
 		public:
 			typedef Node										node_type;
-			typedef typename node_type::BaseNode				BaseNode;
-			typedef typename BaseNode::allocator_type			allocator_type;
-			typedef typename BaseNode::difference_type			difference_type;
-			typedef typename BaseNode::reference				reference;
-			typedef typename BaseNode::const_reference			const_reference;
-			typedef typename BaseNode::pointer					pointer;
-			typedef typename BaseNode::const_pointer			const_pointer;
+			typedef typename node_type::allocator_type			allocator_type;
+			typedef typename node_type::difference_type			difference_type;
+			typedef typename node_type::reference				reference;
+			typedef typename node_type::const_reference			const_reference;
+			typedef typename node_type::pointer					pointer;
+			typedef typename node_type::const_pointer			const_pointer;
 			typedef IteratorType								self_type;
 			
 			explicit Iterator(node_type *node) :_pNode(node) { }
@@ -69,13 +68,12 @@ namespace FclEx
 
 		public:
 			typedef Node										node_type;
-			typedef typename node_type::BaseNode				BaseNode;
-			typedef typename BaseNode::allocator_type			allocator_type;
-			typedef typename BaseNode::difference_type			difference_type;
-			typedef typename BaseNode::reference				reference;
-			typedef typename BaseNode::const_reference			const_reference;
-			typedef typename BaseNode::pointer					pointer;
-			typedef typename BaseNode::const_pointer			const_pointer;
+			typedef typename node_type::allocator_type			allocator_type;
+			typedef typename node_type::difference_type			difference_type;
+			typedef typename node_type::reference				reference;
+			typedef typename node_type::const_reference			const_reference;
+			typedef typename node_type::pointer					pointer;
+			typedef typename node_type::const_pointer			const_pointer;
 			typedef IteratorType								self_type;
 
 			explicit ConstIterator(const node_type *node) :_pNode(node) { }
@@ -0,0 +1,843 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "Define.h"
+#include "Comparer.hpp"
+#include "SkipList.hpp"
+#include "NonCopyable.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <io.h>
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace FclEx
+{
+	namespace Collections
+	{
+		using namespace std;
+
+		// A file written through a stdio buffer that, unlike an ofstream, can be forced to disk.
+		class LsmFile : NonCopyable
+		{
+		public:
+
+			LsmFile(const string &filename, const char *mode) :
+				_file(fopen(filename.c_str(), mode))
+			{
+				if (_file == null) throw runtime_error("Cannot open " + filename + ".");
+			}
+
+			~LsmFile() noexcept
+			{
+				if (_file != null) fclose(_file);
+			}
+
+			void Write(const void *data, SizeType size)
+			{
+				if (size != 0 && fwrite(data, 1, size, _file) != size) throw runtime_error("Cannot write the file.");
+			}
+
+			// Hands the buffered data to the system, where it survives a crash of the process but not of the machine.
+			void Flush()
+			{
+				if (fflush(_file) != 0) throw runtime_error("Cannot write the file.");
+			}
+
+			// Flushes and waits until the data is on disk.
+			void Sync()
+			{
+				Flush();
+#ifdef _WIN32
+				if (_commit(_fileno(_file)) != 0) throw runtime_error("Cannot sync the file.");
+#else
+				if (fsync(fileno(_file)) != 0) throw runtime_error("Cannot sync the file.");
+#endif
+			}
+
+			// Makes the names created, renamed or removed in the directory durable; NTFS does so with the files themselves.
+			static void SyncDirectory(const string &directory)
+			{
+#ifndef _WIN32
+				var file = open(directory.c_str(), O_RDONLY);
+				if (file < 0) throw runtime_error("Cannot open " + directory + ".");
+				var result = fsync(file);
+				close(file);
+				if (result != 0) throw runtime_error("Cannot sync " + directory + ".");
+#endif
+			}
+
+			// The names of the files in the directory.
+			static vector<string> List(const string &directory)
+			{
+				vector<string> names;
+#ifdef _WIN32
+				WIN32_FIND_DATAA data;
+				var find = FindFirstFileA((directory + "/*").c_str(), &data);
+				if (find == INVALID_HANDLE_VALUE) return names;
+				do
+				{
+					names.push_back(data.cFileName);
+				} while (FindNextFileA(find, &data));
+				FindClose(find);
+#else
+				var dir = opendir(directory.c_str());
+				if (dir == null) return names;
+				while (var entry = readdir(dir))
+				{
+					names.push_back(entry->d_name);
+				}
+				closedir(dir);
+#endif
+				return names;
+			}
+
+		private:
+			FILE *_file;
+		};
+
+		// A value as stored by LsmStore; a deleted entry is a tombstone that hides the older values of its key.
+		template<typename TValue>
+		struct LsmEntry
+		{
+			TValue Value;
+			bool Deleted;
+
+			// The memtable, like any SkipList, orders its values.
+			bool operator<(const LsmEntry &other) const
+			{
+				return Deleted != other.Deleted ? Deleted < other.Deleted : Value < other.Value;
+			}
+		};
+
+		// Walks entries in key order.
+		template<typename TKey, typename TValue>
+		class LsmCursor
+		{
+		public:
+			virtual ~LsmCursor() = default;
+			virtual bool Valid() const = 0;
+			virtual const TKey &Key() const = 0;
+			virtual const LsmEntry<TValue> &Entry() const = 0;
+			virtual void Next() = 0;
+		};
+
+		// An immutable file of entries sorted by key. Entries are fixed-size records grouped in blocks of BlockEntries,
+		// followed by the block index (the first key of every block), the number of entries and a magic number.
+		// Only the index is kept in memory; a lookup reads a single block.
+		template<typename TKey, typename TValue, typename TLess>
+		class SortedRun : NonCopyable
+		{
+		public:
+
+			using Entry = LsmEntry<TValue>;
+
+			static constexpr SizeType BlockEntries = 128;
+			static constexpr SizeType RecordSize = 1 + sizeof(TKey) + sizeof(TValue);
+
+			static void Encode(char *record, const TKey &key, const Entry &entry)
+			{
+				record[0] = entry.Deleted ? 1 : 0;
+				memcpy(record + 1, &key, sizeof(TKey));
+				memcpy(record + 1 + sizeof(TKey), &entry.Value, sizeof(TValue));
+			}
+
+			static void Decode(const char *record, TKey &key, Entry &entry)
+			{
+				entry.Deleted = record[0] != 0;
+				memcpy(&key, record + 1, sizeof(TKey));
+				memcpy(&entry.Value, record + 1 + sizeof(TKey), sizeof(TValue));
+			}
+
+			// Writes the entries of the cursor to a new run file, leaving out tombstones when dropDeleted is set.
+			// The file is on disk when this returns, before any manifest names it.
+			static void Write(const string &filename, LsmCursor<TKey, TValue> &cursor, bool dropDeleted)
+			{
+				LsmFile file(filename, "wb");
+				vector<TKey> firstKeys;
+				UInt64 count = 0;
+				char record[RecordSize];
+				for (; cursor.Valid(); cursor.Next())
+				{
+					if (dropDeleted && cursor.Entry().Deleted) continue;
+					if (count % BlockEntries == 0) firstKeys.push_back(cursor.Key());
+					Encode(record, cursor.Key(), cursor.Entry());
+					file.Write(record, RecordSize);
+					++count;
+				}
+				file.Write(firstKeys.data(), firstKeys.size() * sizeof(TKey));
+				file.Write(&count, sizeof(count));
+				var magic = Magic;
+				file.Write(&magic, sizeof(magic));
+				file.Sync();
+			}
+
+			SortedRun(const string &filename, UInt64 id) :
+				_filename(filename),
+				_id(id),
+				_file(filename, ios::binary),
+				_obsolete(false)
+			{
+				UInt64 count = 0;
+				UInt64 magic = 0;
+				_file.seekg(-static_cast<streamoff>(sizeof(count) + sizeof(magic)), ios::end);
+				_file.read(reinterpret_cast<char*>(&count), sizeof(count));
+				_file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+				if (!_file || magic != Magic) throw runtime_error("The file is not a sorted run.");
+
+				_count = static_cast<SizeType>(count);
+				_firstKeys.resize((_count + BlockEntries - 1) / BlockEntries);
+				_file.seekg(static_cast<streamoff>(_count * RecordSize));
+				_file.read(reinterpret_cast<char*>(_firstKeys.data()), _firstKeys.size() * sizeof(TKey));
+				if (!_file) throw runtime_error("The file is not a sorted run.");
+			}
+
+			~SortedRun()
+			{
+				_file.close();
+				if (_obsolete) remove(_filename.c_str());
+			}
+
+			UInt64 Id() const
+			{
+				return _id;
+			}
+
+			SizeType Count() const
+			{
+				return _count;
+			}
+
+			SizeType BlocksCount() const
+			{
+				return _firstKeys.size();
+			}
+
+			// The file is deleted once nothing reads the run any more.
+			void MarkObsolete()
+			{
+				_obsolete = true;
+			}
+
+			bool Find(const TKey &key, Entry &entry) const
+			{
+				// The key can only be in the last block whose first key is not greater than it.
+				var block = upper_bound(_firstKeys.begin(), _firstKeys.end(), key,
+					[this](const TKey &lhs, const TKey &rhs) { return _comparer.Less(lhs, rhs); });
+				if (block == _firstKeys.begin()) return false;
+
+				vector<char> buffer;
+				var count = ReadBlock(static_cast<SizeType>(block - _firstKeys.begin()) - 1, buffer);
+				SizeType lo = 0;
+				var hi = count;
+				TKey current;
+				while (lo < hi)
+				{
+					var mid = lo + (hi - lo) / 2;
+					Decode(&buffer[mid * RecordSize], current, entry);
+					if (_comparer.Less(current, key)) lo = mid + 1;
+					else hi = mid;
+				}
+				if (lo == count) return false;
+				Decode(&buffer[lo * RecordSize], current, entry);
+				return _comparer.Equals(current, key);
+			}
+
+			// Reads the records of the block into the buffer and returns how many there are.
+			SizeType ReadBlock(SizeType block, vector<char> &buffer) const
+			{
+				var first = block * BlockEntries;
+				var count = _count - first < BlockEntries ? _count - first : BlockEntries;
+				buffer.resize(count * RecordSize);
+
+				lock_guard<mutex> lock(_mutex);
+				_file.clear();
+				_file.seekg(static_cast<streamoff>(first * RecordSize));
+				_file.read(buffer.data(), buffer.size());
+				if (!_file) throw runtime_error("Cannot read the sorted run.");
+				return count;
+			}
+
+		private:
+
+			static constexpr UInt64 Magic = 0x4E555254524F53;	// "SORTRUN"
+
+			const string _filename;
+			const UInt64 _id;
+			mutable ifstream _file;
+			mutable mutex _mutex;							// Lookups and compaction may read the run at the same time
+			atomic<bool> _obsolete;
+			SizeType _count;
+			vector<TKey> _firstKeys;
+			const Comparer<TKey, TLess> _comparer;
+		};
+
+		template<typename TKey, typename TValue, typename TLess>
+		class SortedRunCursor : public LsmCursor<TKey, TValue>
+		{
+		public:
+
+			using Run = SortedRun<TKey, TValue, TLess>;
+
+			explicit SortedRunCursor(shared_ptr<Run> run) :
+				_run(move(run)),
+				_block(0),
+				_index(0),
+				_count(0)
+			{
+				Load();
+			}
+
+			bool Valid() const override
+			{
+				return _index < _count;
+			}
+
+			const TKey &Key() const override
+			{
+				return _key;
+			}
+
+			const LsmEntry<TValue> &Entry() const override
+			{
+				return _entry;
+			}
+
+			void Next() override
+			{
+				if (++_index == _count)
+				{
+					++_block;
+					_index = 0;
+					Load();
+				}
+				else
+				{
+					Run::Decode(&_buffer[_index * Run::RecordSize], _key, _entry);
+				}
+			}
+
+		private:
+			shared_ptr<Run> _run;
+			vector<char> _buffer;
+			SizeType _block;
+			SizeType _index;
+			SizeType _count;
+			TKey _key;
+			LsmEntry<TValue> _entry;
+
+			void Load()
+			{
+				_count = _block < _run->BlocksCount() ? _run->ReadBlock(_block, _buffer) : 0;
+				if (_count > 0) Run::Decode(&_buffer[0], _key, _entry);
+			}
+		};
+
+		template<typename TKey, typename TValue, typename TLess>
+		class MemtableCursor : public LsmCursor<TKey, TValue>
+		{
+		public:
+
+			using Memtable = SkipList<TKey, LsmEntry<TValue>, TLess>;
+
+			explicit MemtableCursor(const Memtable &memtable) :
+				_current(memtable.begin()),
+				_end(memtable.end())
+			{ }
+
+			bool Valid() const override
+			{
+				return _current != _end;
+			}
+
+			const TKey &Key() const override
+			{
+				return _current.GetNode()->Item.first;
+			}
+
+			const LsmEntry<TValue> &Entry() const override
+			{
+				return _current.GetNode()->Item.second;
+			}
+
+			void Next() override
+			{
+				++_current;
+			}
+
+		private:
+			typename Memtable::Iterator _current;
+			typename Memtable::Iterator _end;
+		};
+
+		// Merges cursors given newest first: of the entries with the same key only the newest one is seen.
+		template<typename TKey, typename TValue, typename TLess>
+		class MergeCursor : public LsmCursor<TKey, TValue>
+		{
+		public:
+
+			explicit MergeCursor(vector<unique_ptr<LsmCursor<TKey, TValue>>> sources) :
+				_sources(move(sources))
+			{
+				Select();
+			}
+
+			bool Valid() const override
+			{
+				return _current >= 0;
+			}
+
+			const TKey &Key() const override
+			{
+				return _sources[_current]->Key();
+			}
+
+			const LsmEntry<TValue> &Entry() const override
+			{
+				return _sources[_current]->Entry();
+			}
+
+			void Next() override
+			{
+				var key = Key();
+				for (var &source : _sources)
+				{
+					if (source->Valid() && _comparer.Equals(source->Key(), key)) source->Next();
+				}
+				Select();
+			}
+
+		private:
+			vector<unique_ptr<LsmCursor<TKey, TValue>>> _sources;
+			Int32 _current;
+			const Comparer<TKey, TLess> _comparer;
+
+			void Select()
+			{
+				_current = -1;
+				for (var i = 0; i < static_cast<Int32>(_sources.size()); ++i)
+				{
+					// Strictly less, so that the newest source wins a tie.
+					if (_sources[i]->Valid() && (_current < 0 || _comparer.Less(_sources[i]->Key(), _sources[_current]->Key())))
+					{
+						_current = i;
+					}
+				}
+			}
+		};
+
+		// A log-structured key-value store on local files, with a SkipList as its memtable.
+		// Writes are appended to a write-ahead log and applied to the memtable; a full memtable is written out
+		// as a SortedRun, and once CompactionTrigger runs exist a background thread merges them into one.
+		// Reads look at the memtable and then at the runs from newest to oldest.
+		// The log is synced to disk every syncInterval writes, so with the default of 1 a write is durable once Put or Remove
+		// returns; a larger interval groups the syncs, and a crash of the machine may lose the writes since the last one.
+		// Runs and the manifest are synced before the log is truncated.
+		// The store is used from one thread; keys and values must be trivially copyable.
+		template<typename TKey, typename TValue, typename TLess = less<TKey>>
+		class LsmStore : NonCopyable
+		{
+			static_assert(is_trivially_copyable<TKey>::value && is_trivially_copyable<TValue>::value, "Keys and values must be trivially copyable.");
+
+		public:
+
+			using Entry = LsmEntry<TValue>;
+			using Run = SortedRun<TKey, TValue, TLess>;
+			using Cursor = LsmCursor<TKey, TValue>;
+			using ItemType = pair<TKey, TValue>;
+
+			// Walks the live items of the store in key order. Writes to the store invalidate it.
+			class Iterator : public iterator<input_iterator_tag, ItemType>
+			{
+			public:
+
+				explicit Iterator(shared_ptr<Cursor> cursor = null) :
+					_cursor(move(cursor))
+				{
+					SkipDeleted();
+				}
+
+				const ItemType &operator*() const
+				{
+					return _item;
+				}
+
+				const ItemType *operator->() const
+				{
+					return &_item;
+				}
+
+				Iterator &operator++()
+				{
+					_cursor->Next();
+					SkipDeleted();
+					return *this;
+				}
+
+				bool operator==(const Iterator &other) const
+				{
+					return _cursor == other._cursor;
+				}
+
+				bool operator!=(const Iterator &other) const
+				{
+					return !operator==(other);
+				}
+
+			private:
+				shared_ptr<Cursor> _cursor;
+				ItemType _item;
+
+				void SkipDeleted()
+				{
+					if (_cursor == null) return;
+					while (_cursor->Valid() && _cursor->Entry().Deleted)
+					{
+						_cursor->Next();
+					}
+					if (!_cursor->Valid())
+					{
+						// Ended iterators compare equal to end().
+						_cursor = null;
+						return;
+					}
+					_item = ItemType(_cursor->Key(), _cursor->Entry().Value);
+				}
+			};
+
+			// Opens the store kept in the directory, which must exist, and replays its log into the memtable.
+			// Run files the manifest does not list, left by a crash, are deleted.
+			// A syncInterval of 0 leaves syncing the log to the system, see Sync.
+			explicit LsmStore(const string &directory, SizeType memtableLimit = 64 * 1024, SizeType syncInterval = 1) :
+				_directory(directory),
+				_memtableLimit(memtableLimit),
+				_syncInterval(syncInterval),
+				_unsynced(0),
+				_nextRunId(1),
+				_compacting(false)
+			{
+				ReadManifest();
+				RemoveUnlistedRuns();
+				ReplayLog();
+				_log.reset(new LsmFile(LogFile(), "ab"));
+			}
+
+			// A failed background compaction is not reported here, since a destructor cannot throw; the runs it
+			// failed to merge are intact and merged by a later compaction.
+			~LsmStore()
+			{
+				if (_compaction.joinable()) _compaction.join();
+			}
+
+			void Put(const TKey &key, const TValue &value)
+			{
+				Write(key, Entry{ value, false });
+			}
+
+			void Remove(const TKey &key)
+			{
+				Write(key, Entry{ default(TValue), true });
+			}
+
+			bool TryGetValue(const TKey &key, TValue &value) const
+			{
+				Entry entry;
+				if (!Find(key, entry) || entry.Deleted) return false;
+				value = entry.Value;
+				return true;
+			}
+
+			bool ContainsKey(const TKey &key) const
+			{
+				Entry entry;
+				return Find(key, entry) && !entry.Deleted;
+			}
+
+			Iterator begin() const
+			{
+				vector<unique_ptr<Cursor>> sources;
+				sources.emplace_back(new MemtableCursor<TKey, TValue, TLess>(_memtable));
+				for (var &run : GetRuns())
+				{
+					sources.emplace_back(new SortedRunCursor<TKey, TValue, TLess>(run));
+				}
+				return Iterator(make_shared<MergeCursor<TKey, TValue, TLess>>(move(sources)));
+			}
+
+			Iterator end() const
+			{
+				return Iterator();
+			}
+
+			// Syncs the writes logged so far to disk.
+			void Sync()
+			{
+				_log->Sync();
+				_unsynced = 0;
+			}
+
+			// Writes the memtable out as a sorted run and starts a new log.
+			// Throws the failure of a background compaction that ended since, once the flush itself has completed.
+			void Flush()
+			{
+				if (_memtable.Count() == 0) return;
+
+				var id = NextRunId();
+				MemtableCursor<TKey, TValue, TLess> cursor(_memtable);
+				// Tombstones are kept: older runs may still hold their keys.
+				Run::Write(RunFile(id), cursor, false);
+				var run = make_shared<Run>(RunFile(id), id);
+				{
+					lock_guard<mutex> lock(_mutex);
+					_runs.insert(_runs.begin(), run);
+					WriteManifest();
+				}
+
+				_memtable.Clear();
+				_log.reset();
+				_log.reset(new LsmFile(LogFile(), "wb"));
+				_unsynced = 0;
+
+				if (!_compacting)
+				{
+					JoinCompaction();
+					if (GetRuns().size() >= CompactionTrigger)
+					{
+						_compacting = true;
+						_compaction = thread([this]()
+						{
+							try
+							{
+								Compact(GetRuns());
+							}
+							catch (...)
+							{
+								// The runs stay as they are; the next flush reports the failure and tries again.
+								_compactionError = current_exception();
+							}
+							_compacting = false;
+						});
+					}
+				}
+			}
+
+			// Merges all sorted runs into one, waiting for a background compaction first and throwing its failure.
+			void Compact()
+			{
+				JoinCompaction();
+				Compact(GetRuns());
+			}
+
+			SizeType RunsCount() const
+			{
+				return GetRuns().size();
+			}
+
+		private:
+
+			static constexpr SizeType CompactionTrigger = 4;	// Number of runs that starts a background compaction
+
+			const string _directory;
+			const SizeType _memtableLimit;					// Number of entries the memtable holds before it is flushed
+			const SizeType _syncInterval;					// Writes between syncs of the log, or 0
+			SizeType _unsynced;								// Writes logged since the last sync
+			SkipList<TKey, Entry, TLess> _memtable;
+			unique_ptr<LsmFile> _log;
+			vector<shared_ptr<Run>> _runs;					// Newest first, guarded by _mutex
+			UInt64 _nextRunId;								// Guarded by _mutex
+			mutable mutex _mutex;
+			thread _compaction;
+			atomic<bool> _compacting;
+			exception_ptr _compactionError;					// Set by the compaction thread, read after joining it
+			const Comparer<TKey, TLess> _comparer;
+
+			string LogFile() const
+			{
+				return _directory + "/log";
+			}
+
+			string ManifestFile() const
+			{
+				return _directory + "/manifest";
+			}
+
+			string RunFile(UInt64 id) const
+			{
+				return _directory + "/run-" + to_string(id);
+			}
+
+			UInt64 NextRunId()
+			{
+				lock_guard<mutex> lock(_mutex);
+				return _nextRunId++;
+			}
+
+			vector<shared_ptr<Run>> GetRuns() const
+			{
+				lock_guard<mutex> lock(_mutex);
+				return _runs;
+			}
+
+			void Write(const TKey &key, const Entry &entry)
+			{
+				char record[Run::RecordSize];
+				Run::Encode(record, key, entry);
+				_log->Write(record, Run::RecordSize);
+				if (_syncInterval != 0 && ++_unsynced >= _syncInterval) Sync();
+				else _log->Flush();
+
+				_memtable[key] = entry;
+				if (_memtable.Count() >= _memtableLimit) Flush();
+			}
+
+			bool Find(const TKey &key, Entry &entry) const
+			{
+				var it = _memtable.lower_bound(key);
+				if (it != _memtable.end() && _comparer.Equals(it->first, key))
+				{
+					entry = it->second;
+					return true;
+				}
+				for (var &run : GetRuns())
+				{
+					if (run->Find(key, entry)) return true;
+				}
+				return false;
+			}
+
+			// Waits for the background compaction and rethrows its failure, if any.
+			void JoinCompaction()
+			{
+				if (_compaction.joinable()) _compaction.join();
+				if (_compactionError != null)
+				{
+					var error = _compactionError;
+					_compactionError = null;
+					rethrow_exception(error);
+				}
+			}
+
+			// Replaces the runs, which must be the oldest ones, by their merge.
+			void Compact(const vector<shared_ptr<Run>> &runs)
+			{
+				if (runs.size() < 2) return;
+
+				vector<unique_ptr<Cursor>> sources;
+				for (var &run : runs)
+				{
+					sources.emplace_back(new SortedRunCursor<TKey, TValue, TLess>(run));
+				}
+				MergeCursor<TKey, TValue, TLess> cursor(move(sources));
+				var id = NextRunId();
+				// The oldest run takes part, so no older value is left for a tombstone to hide.
+				Run::Write(RunFile(id), cursor, true);
+				var merged = make_shared<Run>(RunFile(id), id);
+
+				lock_guard<mutex> lock(_mutex);
+				// Runs flushed meanwhile are newer and stay in front.
+				_runs.resize(_runs.size() - runs.size());
+				_runs.push_back(merged);
+				WriteManifest();
+				for (var &run : runs)
+				{
+					run->MarkObsolete();
+				}
+			}
+
+			// The manifest holds the next run id and the ids of the live runs, newest first.
+			// It is written aside and renamed over the old one, so a crash leaves one of the two.
+			void WriteManifest() const
+			{
+				var temp = ManifestFile() + ".tmp";
+				{
+					LsmFile file(temp, "wb");
+					UInt64 count = _runs.size();
+					file.Write(&_nextRunId, sizeof(_nextRunId));
+					file.Write(&count, sizeof(count));
+					for (var &run : _runs)
+					{
+						var id = run->Id();
+						file.Write(&id, sizeof(id));
+					}
+					file.Sync();
+				}
+#ifdef _WIN32
+				// rename does not replace an existing file on Windows.
+				remove(ManifestFile().c_str());
+#endif
+				if (rename(temp.c_str(), ManifestFile().c_str()) != 0) throw runtime_error("Cannot write the manifest.");
+				LsmFile::SyncDirectory(_directory);
+			}
+
+			// Deletes the run files missing from the manifest: runs being written or merged, or obsolete and not yet deleted,
+			// when the process stopped.
+			void RemoveUnlistedRuns()
+			{
+				for (var &name : LsmFile::List(_directory))
+				{
+					if (name.compare(0, 4, "run-") != 0 || name.size() == 4
+						|| name.find_first_not_of("0123456789", 4) != string::npos) continue;
+					var id = stoull(name.substr(4));
+					var listed = false;
+					for (var &run : _runs)
+					{
+						listed = listed || run->Id() == id;
+					}
+					if (!listed) remove(RunFile(id).c_str());
+				}
+			}
+
+			void ReadManifest()
+			{
+				ifstream file(ManifestFile(), ios::binary);
+				if (!file) return;
+
+				UInt64 count = 0;
+				file.read(reinterpret_cast<char*>(&_nextRunId), sizeof(_nextRunId));
+				file.read(reinterpret_cast<char*>(&count), sizeof(count));
+				for (UInt64 i = 0; i < count; ++i)
+				{
+					UInt64 id = 0;
+					file.read(reinterpret_cast<char*>(&id), sizeof(id));
+					if (!file) throw runtime_error("The manifest is damaged.");
+					_runs.push_back(make_shared<Run>(RunFile(id), id));
+				}
+			}
+
+			// Applies the logged writes that were not flushed yet; a torn last record is ignored.
+			void ReplayLog()
+			{
+				ifstream file(LogFile(), ios::binary);
+				char record[Run::RecordSize];
+				TKey key;
+				Entry entry;
+				while (file.read(record, Run::RecordSize))
+				{
+					Run::Decode(record, key, entry);
+					_memtable[key] = entry;
+				}
+			}
+		};
+	}
+}
@@ -0,0 +1,452 @@
+#pragma once
+
+#include "Define.h"
+#include "IKeyValueCollection.h"
+#include "Random.hpp"
+#include "SkipListLevel.hpp"
+#include "Comparer.hpp"
+#include "Iterator.hpp"
+#include "MemoryMappedFile.hpp"
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include "NonCopyable.hpp"
+
+namespace FclEx
+{
+	namespace Collections
+	{
+		using namespace std;
+		using namespace Node;
+
+		// A skip list node stored in a mapped file: links are offsets from the start of the file
+		// instead of pointers, with 0 (where the file header lives) standing for NIL.
+		template<typename TKey, typename TValue, typename TOffset>
+		class MappedSkipListNode
+		{
+		public:
+
+			typedef allocator<pair<TKey, TValue>>				allocator_type;
+			typedef typename allocator_type::difference_type    difference_type;
+			typedef typename allocator_type::reference          reference;
+			typedef typename allocator_type::const_reference    const_reference;
+			typedef typename allocator_type::pointer            pointer;
+			typedef typename allocator_type::const_pointer      const_pointer;
+			typedef pair<TKey, TValue>							value_type;
+
+			using PNode = MappedSkipListNode*;
+			using ItemType = pair<TKey, TValue>;
+
+			ItemType Item;
+
+			// Constructs a node in memory of AllocationSize(level) bytes.
+			template<typename ...Args>
+			static PNode Create(char *memory, SizeType level, Args&&... args)
+			{
+				return ::new (static_cast<void*>(memory)) MappedSkipListNode(level, forward<Args>(args)...);
+			}
+
+			static constexpr SizeType AllocationSize(SizeType level)
+			{
+				return (sizeof(MappedSkipListNode) + (level - 1) * sizeof(TOffset) + alignof(MappedSkipListNode) - 1)
+					/ alignof(MappedSkipListNode) * alignof(MappedSkipListNode);
+			}
+
+			MappedSkipListNode(const MappedSkipListNode &) = delete;
+			MappedSkipListNode& operator=(const MappedSkipListNode &) = delete;
+
+			TOffset Next() const
+			{
+				return NeighborNodes[0];
+			}
+
+			SizeType Height() const
+			{
+				return _height;
+			}
+
+		private:
+
+			UInt32 _height;
+
+		public:
+
+			// Declared with one slot, but AllocationSize() leaves room for Height() slots.
+			TOffset NeighborNodes[1];
+
+		private:
+
+			template<typename ...Args>
+			explicit MappedSkipListNode(SizeType level, Args&&... args) :
+				Item(forward<Args>(args)...),
+				_height(static_cast<UInt32>(level))
+			{
+				for (SizeType i = 0; i < level; ++i)
+				{
+					NeighborNodes[i] = 0;
+				}
+			}
+		};
+
+		template<typename TKey, typename TValue, typename TOffset>
+		class MappedSkipListIterator : public Node::Iterator<MappedSkipListNode<TKey, TValue, TOffset>, MappedSkipListIterator<TKey, TValue, TOffset>>
+		{
+		public:
+			using Iterator = Node::Iterator<MappedSkipListNode<TKey, TValue, TOffset>, MappedSkipListIterator>;
+			using IteratorType = typename Iterator::self_type;
+			using NodeType = typename Iterator::node_type;
+
+			// The base of the mapping resolves the offsets.
+			MappedSkipListIterator(NodeType *node, char *base) :Iterator(node), _base(base) { }
+
+			IteratorType &operator++() override
+			{
+				var next = Iterator::_pNode->Next();
+				Iterator::_pNode = next == 0 ? null : reinterpret_cast<NodeType*>(_base + next);
+				return *this;
+			}
+
+			IteratorType operator++(int) override
+			{
+				IteratorType old(*this);
+				operator++();
+				return old;
+			}
+
+		private:
+			char *_base;
+		};
+
+		// A skip list whose nodes live in a memory-mapped file, so it reopens without loading anything
+		// and only the pages a search touches are read. Freed nodes are kept on one free list per height
+		// and reused by later inserts of the same height. Keys and values must be trivially copyable.
+		// Inserts may grow and remap the file, which invalidates iterators and references to values.
+		template<typename TKey,
+			typename TValue,
+			typename TLess = less<TKey>,
+			typename TOffset = UInt64>
+			class MappedSkipList : IKeyValueCollection<TKey, TValue>, NonCopyable
+		{
+			static_assert(is_trivially_copyable<TKey>::value && is_trivially_copyable<TValue>::value, "Keys and values must be trivially copyable.");
+			static_assert(is_unsigned<TOffset>::value, "Offsets must be unsigned.");
+
+		public:
+
+			using Node = MappedSkipListNode<TKey, TValue, TOffset>;
+			using PNode = typename Node::PNode;
+			using ItemType = typename Node::ItemType;
+			using Iterator = MappedSkipListIterator<TKey, TValue, TOffset>;
+
+			Iterator begin() const
+			{
+				return Iterator(Resolve(Head()->Next()), _file.Data());
+			}
+
+			Iterator end() const
+			{
+				return Iterator(null, _file.Data());
+			}
+
+			// Opens the list stored in the file, or creates an empty one when the file is empty or does not exist.
+			explicit MappedSkipList(const char *filename) :
+				_file(filename)
+			{
+				if (_file.Size() == 0)
+				{
+					_file.Resize(InitialSize);
+					Initialize();
+					return;
+				}
+
+				var &header = GetHeader();
+				if (_file.Size() < HeaderSize
+					|| header.Magic != Magic
+					|| header.KeySize != sizeof(TKey)
+					|| header.ValueSize != sizeof(TValue)
+					|| header.OffsetSize != sizeof(TOffset))
+				{
+					throw runtime_error("The file does not hold a skip list of this type.");
+				}
+				// The head is always laid out right after the header, and every offset followed later lies before End.
+				if (header.Head != HeaderSize
+					|| header.End < HeaderSize + Node::AllocationSize(MaxLevel)
+					|| header.End > _file.Size()
+					|| header.ListLevel < 1
+					|| header.ListLevel > MaxLevel)
+				{
+					throw runtime_error("The skip list file is corrupt.");
+				}
+			}
+
+			SizeType Count() const override
+			{
+				return static_cast<SizeType>(GetHeader().Count);
+			}
+
+			void Add(const ItemType &item) override
+			{
+				TOffset prevNodes[MaxLevel];
+				if (!FindPrevNodes(item.first, prevNodes))
+				{
+					Insert(item, prevNodes);
+				}
+			}
+
+			void Clear() override
+			{
+				Initialize();
+			}
+
+			bool Contains(const ItemType &item) const override
+			{
+				var node = Find(item.first);
+				return node != null && _valueComparer.Equals(node->Item.second, item.second);
+			}
+
+			bool Remove(const ItemType &item) override
+			{
+				return Remove(item.first, true, item.second);
+			}
+
+			//// index-get
+			const TValue& operator[](const TKey& key) const override
+			{
+				var node = Find(key);
+				return node == null ? _defaultValue : node->Item.second;
+			}
+
+			//// index-set
+			TValue& operator[](const TKey& key) override
+			{
+				TOffset prevNodes[MaxLevel];
+				if (FindPrevNodes(key, prevNodes))
+				{
+					return Resolve(Resolve(prevNodes[0])->Next())->Item.second;
+				}
+				return Resolve(Insert(ItemType(key, default(TValue)), prevNodes))->Item.second;
+			}
+
+			void Add(const TKey& key, const TValue& value) override
+			{
+				Add(ItemType(key, value));
+			}
+
+			bool ContainsKey(const TKey& key) const override
+			{
+				return Find(key) != null;
+			}
+
+			bool ContainsValue(const TValue& value) const override
+			{
+				for (const auto &item : *this)
+				{
+					if (_valueComparer.Equals(item.second, value)) return true;
+				}
+				return false;
+			}
+
+			bool Remove(const TKey& key) override
+			{
+				return Remove(key, false);
+			}
+
+			// Writes the changes back to the file.
+			void Flush() const
+			{
+				_file.Flush();
+			}
+
+		private:
+
+			static constexpr UInt32 MaxLevel = 32;			// Maximum level any node in a skip list can have
+			static constexpr double Probability = 0.5;		// Probability factor used to determine the node level
+			static constexpr UInt64 Magic = 0x5453494C50494B53;	// "SKIPLIST"
+			static constexpr SizeType InitialSize = 64 * 1024;
+
+			// Lives at offset 0 of the file.
+			struct Header
+			{
+				UInt64 Magic;
+				UInt32 KeySize;
+				UInt32 ValueSize;
+				UInt32 OffsetSize;
+				UInt32 ListLevel;							// Current maximum list level.
+				UInt64 Count;								// Current number of elements in the skip list.
+				TOffset Head;								// The skip list header.
+				TOffset End;								// Where the unused space of the file starts.
+				TOffset FreeNodes[MaxLevel];				// Freed nodes of each height, linked through their first link.
+			};
+
+			static constexpr SizeType HeaderSize = (sizeof(Header) + alignof(Node) - 1) / alignof(Node) * alignof(Node);
+
+			MemoryMappedFile _file;
+			const TValue _defaultValue = default(TValue);
+			const Comparer<TKey, TLess> _comparer;
+			const Comparer<TValue> _valueComparer;
+			const Random _random;
+
+			Header &GetHeader() const
+			{
+				return *reinterpret_cast<Header*>(_file.Data());
+			}
+
+			PNode Resolve(TOffset offset) const
+			{
+				return offset == 0 ? null : reinterpret_cast<PNode>(_file.Data() + offset);
+			}
+
+			PNode Head() const
+			{
+				return Resolve(GetHeader().Head);
+			}
+
+			Int32 GetNewLevel() const
+			{
+				return NewLevel(_random, static_cast<Int32>(GetHeader().ListLevel), MaxLevel, Probability);
+			}
+
+			// Takes space for a node of the height from its free list, or from the end of the file, growing it when full.
+			// Growing remaps the file, so no node pointer may be held across this call.
+			TOffset Allocate(SizeType level)
+			{
+				var &header = GetHeader();
+				var free = header.FreeNodes[level - 1];
+				if (free != 0)
+				{
+					header.FreeNodes[level - 1] = Resolve(free)->Next();
+					return free;
+				}
+
+				var offset = static_cast<UInt64>(header.End);
+				var end = offset + Node::AllocationSize(level);
+				if (end > numeric_limits<TOffset>::max()) throw length_error("The file is full.");
+				if (end > _file.Size())
+				{
+					var size = _file.Size() * 2;
+					_file.Resize(static_cast<SizeType>(end > size ? end : size));
+				}
+				GetHeader().End = static_cast<TOffset>(end);
+				return static_cast<TOffset>(offset);
+			}
+
+			void Free(TOffset offset)
+			{
+				var &header = GetHeader();
+				var node = Resolve(offset);
+				var level = node->Height();
+				node->NeighborNodes[0] = header.FreeNodes[level - 1];
+				header.FreeNodes[level - 1] = offset;
+			}
+
+			PNode Find(const TKey &key) const
+			{
+				var p = Head();
+				for (var i = static_cast<Int32>(GetHeader().ListLevel) - 1; i >= 0; --i)
+				{
+					var next = Resolve(p->NeighborNodes[i]);
+					while (next != null && _comparer.Less(next->Item.first, key))
+					{
+						p = next; // Move forward in the skip list.
+						next = Resolve(p->NeighborNodes[i]);
+					}
+					if (next != null && _comparer.Equals(next->Item.first, key)) return next;
+				}
+				return null;
+			}
+
+			// Fills prevNodes with the offsets of the nodes before the key at every level and returns whether the key exists.
+			bool FindPrevNodes(const TKey &key, TOffset *prevNodes) const
+			{
+				var &header = GetHeader();
+				var offset = header.Head;
+				var p = Resolve(offset);
+				for (var i = static_cast<Int32>(header.ListLevel) - 1; i >= 0; i--)
+				{
+					var next = Resolve(p->NeighborNodes[i]);
+					while (next != null && _comparer.Less(next->Item.first, key))
+					{
+						offset = p->NeighborNodes[i]; // Move forward in the skip list.
+						p = next;
+						next = Resolve(p->NeighborNodes[i]);
+					}
+					prevNodes[i] = offset;
+				}
+				var next = Resolve(p->Next());
+				return next != null && _comparer.Equals(next->Item.first, key);
+			}
+
+			TOffset Insert(const ItemType &item, TOffset *prevNodes)
+			{
+				var newLevel = GetNewLevel(); // Get the level for the new node.
+				var offset = Allocate(newLevel);
+				var newNode = Node::Create(_file.Data() + offset, newLevel, item);
+
+				var &header = GetHeader();
+				if (newLevel > static_cast<Int32>(header.ListLevel))
+				{
+					// Make sure our update references above the current skip list level point to the header.
+					for (var i = static_cast<Int32>(header.ListLevel); i < newLevel; ++i)
+					{
+						prevNodes[i] = header.Head;
+					}
+					header.ListLevel = newLevel; // The current skip list level is now the new node level.
+				}
+				for (var i = 0; i < newLevel; ++i)
+				{
+					var prev = Resolve(prevNodes[i]);
+					newNode->NeighborNodes[i] = prev->NeighborNodes[i];
+					prev->NeighborNodes[i] = offset;
+				}
+				++header.Count;
+				return offset;
+			}
+
+			bool Remove(const TKey &key, bool checkValue, const TValue &value = default(TValue))
+			{
+				TOffset prevNodes[MaxLevel];
+				if (!FindPrevNodes(key, prevNodes)) return false;
+
+				var offset = Resolve(prevNodes[0])->Next();
+				var node = Resolve(offset);
+				if (checkValue && !_valueComparer.Equals(node->Item.second, value)) return false;
+
+				for (var i = 0; i < static_cast<Int32>(node->Height()); i++)
+				{
+					Resolve(prevNodes[i])->NeighborNodes[i] = node->NeighborNodes[i];
+				}
+				Free(offset);
+
+				// After removing the node, we may need to lower the current skip list level if the node had the highest level of all of the nodes.
+				var &header = GetHeader();
+				var head = Head();
+				while (header.ListLevel > 1 && head->NeighborNodes[header.ListLevel - 1] == 0)
+				{
+					--header.ListLevel;
+				}
+				--header.Count;
+				return true;
+			}
+
+			// Lays out an empty list in the file, keeping its size.
+			void Initialize()
+			{
+				var &header = GetHeader();
+				header.Magic = Magic;
+				header.KeySize = sizeof(TKey);
+				header.ValueSize = sizeof(TValue);
+				header.OffsetSize = sizeof(TOffset);
+				header.ListLevel = 1;
+				header.Count = 0;
+				for (var &free : header.FreeNodes)
+				{
+					free = 0;
+				}
+				header.Head = static_cast<TOffset>(HeaderSize);
+				header.End = static_cast<TOffset>(HeaderSize + Node::AllocationSize(MaxLevel));
+				Node::Create(_file.Data() + header.Head, MaxLevel);
+			}
+		};
+	}
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <stdexcept>
+
+#include "Define.h"
+#include "NonCopyable.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace FclEx
+{
+	using namespace std;
+
+	// A file mapped read-write into memory; pages are only read from disk when touched.
+	// Resize() maps the file again, so pointers into Data() do not survive it.
+	class MemoryMappedFile : NonCopyable
+	{
+	public:
+
+		// Opens the file, creating it empty when it does not exist.
+		explicit MemoryMappedFile(const char *filename) :
+			_data(null),
+			_size(0)
+		{
+			Open(filename);
+			try
+			{
+				Map();
+			}
+			catch (...)
+			{
+				Close();
+				throw;
+			}
+		}
+
+		~MemoryMappedFile() noexcept
+		{
+			Unmap();
+			Close();
+		}
+
+		char *Data() const
+		{
+			return _data;
+		}
+
+		SizeType Size() const
+		{
+			return _size;
+		}
+
+		// On failure, e.g. a full disk, the old mapping is restored before the exception leaves, so Data() stays valid.
+		void Resize(SizeType size)
+		{
+			var oldSize = _size;
+			// Windows cannot resize a mapped file.
+			Unmap();
+			try
+			{
+				SetFileSize(size);
+				_size = size;
+				Map();
+			}
+			catch (...)
+			{
+				// A file that shrank is grown back, so the old mapping does not reach past its end.
+				if (_size < oldSize) SetFileSize(oldSize);
+				_size = oldSize;
+				Map();
+				throw;
+			}
+		}
+
+		// Writes the dirty pages back to the file and waits until they are on disk.
+		void Flush() const
+		{
+			if (_data == null) return;
+#ifdef _WIN32
+			if (!FlushViewOfFile(_data, 0) || !FlushFileBuffers(_file)) throw runtime_error("Cannot flush the file.");
+#else
+			if (msync(_data, _size, MS_SYNC) != 0) throw runtime_error("Cannot flush the file.");
+#endif
+		}
+
+	private:
+
+#ifdef _WIN32
+		HANDLE _file = INVALID_HANDLE_VALUE;
+		HANDLE _mapping = null;
+#else
+		int _file = -1;
+#endif
+		char *_data;
+		SizeType _size;
+
+#ifdef _WIN32
+		void Open(const char *filename)
+		{
+			_file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, null, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, null);
+			if (_file == INVALID_HANDLE_VALUE) throw runtime_error("Cannot open the file.");
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(_file, &size))
+			{
+				Close();
+				throw runtime_error("Cannot get the file size.");
+			}
+			_size = static_cast<SizeType>(size.QuadPart);
+		}
+
+		void Close() noexcept
+		{
+			if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+			_file = INVALID_HANDLE_VALUE;
+		}
+
+		void SetFileSize(SizeType size)
+		{
+			LARGE_INTEGER position;
+			position.QuadPart = static_cast<LONGLONG>(size);
+			if (!SetFilePointerEx(_file, position, null, FILE_BEGIN) || !SetEndOfFile(_file))
+			{
+				throw runtime_error("Cannot resize the file.");
+			}
+		}
+
+		void Map()
+		{
+			// An empty file cannot be mapped.
+			if (_size == 0) return;
+			var size = static_cast<UInt64>(_size);
+			_mapping = CreateFileMappingA(_file, null, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), null);
+			if (_mapping == null) throw runtime_error("Cannot map the file.");
+			_data = static_cast<char*>(MapViewOfFile(_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+			if (_data == null)
+			{
+				CloseHandle(_mapping);
+				_mapping = null;
+				throw runtime_error("Cannot map the file.");
+			}
+		}
+
+		void Unmap() noexcept
+		{
+			if (_data != null) UnmapViewOfFile(_data);
+			if (_mapping != null) CloseHandle(_mapping);
+			_data = null;
+			_mapping = null;
+		}
+#else
+		void Open(const char *filename)
+		{
+			_file = open(filename, O_RDWR | O_CREAT, 0644);
+			if (_file < 0) throw runtime_error("Cannot open the file.");
+			struct stat status;
+			if (fstat(_file, &status) != 0)
+			{
+				Close();
+				throw runtime_error("Cannot get the file size.");
+			}
+			_size = static_cast<SizeType>(status.st_size);
+		}
+
+		void Close() noexcept
+		{
+			if (_file >= 0) close(_file);
+			_file = -1;
+		}
+
+		void SetFileSize(SizeType size)
+		{
+			if (ftruncate(_file, static_cast<off_t>(size)) != 0) throw runtime_error("Cannot resize the file.");
+		}
+
+		void Map()
+		{
+			// An empty file cannot be mapped.
+			if (_size == 0) return;
+			var data = mmap(null, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _file, 0);
+			if (data == MAP_FAILED) throw runtime_error("Cannot map the file.");
+			_data = static_cast<char*>(data);
+		}
+
+		void Unmap() noexcept
+		{
+			if (_data != null) munmap(_data, _size);
+			_data = null;
+		}
+#endif
+	};
+}
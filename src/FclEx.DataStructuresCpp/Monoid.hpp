@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+
+#include "Define.h"
+
+namespace FclEx
+{
+	using namespace std;
+
+	// A monoid aggregates values: it names its ValueType, and provides Lift() to turn a value into an aggregate,
+	// an associative Combine() and its Identity(). Combine() is always called with the operands in key order.
+
+	struct NullMonoid
+	{
+		struct ValueType { };
+
+		static ValueType Identity()
+		{
+			return{};
+		}
+
+		static ValueType Combine(const ValueType &, const ValueType &)
+		{
+			return{};
+		}
+
+		template<typename T>
+		static ValueType Lift(const T &)
+		{
+			return{};
+		}
+	};
+
+	template<typename T>
+	struct SumMonoid
+	{
+		using ValueType = T;
+
+		static ValueType Identity()
+		{
+			return default(T);
+		}
+
+		static ValueType Combine(const ValueType &lhs, const ValueType &rhs)
+		{
+			return lhs + rhs;
+		}
+
+		static ValueType Lift(const T &value)
+		{
+			return value;
+		}
+	};
+
+	template<typename T>
+	struct MaxMonoid
+	{
+		using ValueType = T;
+
+		static ValueType Identity()
+		{
+			return numeric_limits<T>::lowest();
+		}
+
+		static ValueType Combine(const ValueType &lhs, const ValueType &rhs)
+		{
+			return max(lhs, rhs);
+		}
+
+		static ValueType Lift(const T &value)
+		{
+			return value;
+		}
+	};
+
+	template<typename T>
+	struct MinMonoid
+	{
+		using ValueType = T;
+
+		static ValueType Identity()
+		{
+			return numeric_limits<T>::max();
+		}
+
+		static ValueType Combine(const ValueType &lhs, const ValueType &rhs)
+		{
+			return min(lhs, rhs);
+		}
+
+		static ValueType Lift(const T &value)
+		{
+			return value;
+		}
+	};
+}
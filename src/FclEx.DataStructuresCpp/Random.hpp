@@ -2,6 +2,7 @@
 
 #include <random>
 #include <ctime>
+#include <stdexcept>
 
 #include "Define.h"
 
@@ -18,6 +19,11 @@ namespace FclEx
 			, _byteDistribution(numeric_limits<byte>::min(), numeric_limits<byte>::max())
 		{ }
 
+		explicit Random(uint seed)
+			: _randomNumberGenerator(seed)
+			, _byteDistribution(numeric_limits<byte>::min(), numeric_limits<byte>::max())
+		{ }
+
 		int Next(int minValue = 0, int maxValue = numeric_limits<int>::max()) const
 		{
 			if (maxValue < minValue)
@@ -48,6 +54,6 @@ namespace FclEx
 
 	private:
 		mutable default_random_engine _randomNumberGenerator;
-		uniform_int_distribution<int> _byteDistribution;
+		mutable uniform_int_distribution<int> _byteDistribution;
 	};
 }
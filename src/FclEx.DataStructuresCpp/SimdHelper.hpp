@@ -0,0 +1,131 @@
+#pragma once
+
+#include <limits>
+#include <type_traits>
+
+#include "Define.h"
+
+// The widest integer compare the target was built for: AVX2 compares 8 int32 or 4 int64 lanes,
+// SSE2 compares 4 int32 lanes and, with SSE4.2, 2 int64 lanes.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FCLEX_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FCLEX_SSE2
+#if defined(__SSE4_2__) || defined(__AVX__)
+#include <nmmintrin.h>
+#define FCLEX_SSE42
+#endif
+#endif
+
+namespace FclEx
+{
+	using namespace std;
+
+	class SimdHelper
+	{
+	public:
+
+		// The number of keys less than the key among the first count, which for sorted keys is the index of its lower bound.
+		// Every key is compared, without branches, a vector of keys at a time; the keys left over are compared one by one.
+		template<typename T>
+		static SizeType CountLess(const T *keys, SizeType count, T key)
+		{
+			static_assert(is_integral<T>::value && (sizeof(T) == 4 || sizeof(T) == 8), "Keys must be 32 or 64 bit integers.");
+			SizeType i = 0;
+			var result = CountLessVector(keys, count, key, i, integral_constant<SizeType, sizeof(T)>());
+			for (; i < count; ++i)
+			{
+				result += keys[i] < key;
+			}
+			return result;
+		}
+
+	private:
+
+		// Unsigned keys are compared as signed ones with the sign bit flipped, which keeps their order.
+		template<typename T, typename TSigned>
+		static TSigned Bias()
+		{
+			return is_signed<T>::value ? 0 : numeric_limits<TSigned>::min();
+		}
+
+#if defined(FCLEX_AVX2)
+		template<typename T>
+		static SizeType CountLessVector(const T *keys, SizeType count, T key, SizeType &i, integral_constant<SizeType, 4>)
+		{
+			var bias = _mm256_set1_epi32(Bias<T, Int32>());
+			var needle = _mm256_xor_si256(_mm256_set1_epi32(static_cast<Int32>(key)), bias);
+			var sum = _mm256_setzero_si256();
+			for (; i + 8 <= count; i += 8)
+			{
+				var block = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), bias);
+				// A lane of a compare is -1 where it holds.
+				sum = _mm256_sub_epi32(sum, _mm256_cmpgt_epi32(needle, block));
+			}
+			Int32 lanes[8];
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sum);
+			return static_cast<SizeType>(lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7]);
+		}
+
+		template<typename T>
+		static SizeType CountLessVector(const T *keys, SizeType count, T key, SizeType &i, integral_constant<SizeType, 8>)
+		{
+			var bias = _mm256_set1_epi64x(Bias<T, Int64>());
+			var needle = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<Int64>(key)), bias);
+			var sum = _mm256_setzero_si256();
+			for (; i + 4 <= count; i += 4)
+			{
+				var block = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), bias);
+				sum = _mm256_sub_epi64(sum, _mm256_cmpgt_epi64(needle, block));
+			}
+			Int64 lanes[4];
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sum);
+			return static_cast<SizeType>(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+		}
+#elif defined(FCLEX_SSE2)
+		template<typename T>
+		static SizeType CountLessVector(const T *keys, SizeType count, T key, SizeType &i, integral_constant<SizeType, 4>)
+		{
+			var bias = _mm_set1_epi32(Bias<T, Int32>());
+			var needle = _mm_xor_si128(_mm_set1_epi32(static_cast<Int32>(key)), bias);
+			var sum = _mm_setzero_si128();
+			for (; i + 4 <= count; i += 4)
+			{
+				var block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), bias);
+				// A lane of a compare is -1 where it holds.
+				sum = _mm_sub_epi32(sum, _mm_cmpgt_epi32(needle, block));
+			}
+			Int32 lanes[4];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+			return static_cast<SizeType>(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+		}
+
+#if defined(FCLEX_SSE42)
+		template<typename T>
+		static SizeType CountLessVector(const T *keys, SizeType count, T key, SizeType &i, integral_constant<SizeType, 8>)
+		{
+			var bias = _mm_set1_epi64x(Bias<T, Int64>());
+			var needle = _mm_xor_si128(_mm_set1_epi64x(static_cast<Int64>(key)), bias);
+			var sum = _mm_setzero_si128();
+			for (; i + 2 <= count; i += 2)
+			{
+				var block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), bias);
+				sum = _mm_sub_epi64(sum, _mm_cmpgt_epi64(needle, block));
+			}
+			Int64 lanes[2];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+			return static_cast<SizeType>(lanes[0] + lanes[1]);
+		}
+#endif
+#endif
+
+		// Without a vector compare for the key size, every key is left to the scalar loop.
+		template<typename T, SizeType Size>
+		static SizeType CountLessVector(const T *, SizeType, T, SizeType &, integral_constant<SizeType, Size>)
+		{
+			return 0;
+		}
+	};
+}
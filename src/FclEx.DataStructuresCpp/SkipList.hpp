@@ -3,10 +3,22 @@
 #include "Define.h"
 #include "IKeyValueCollection.h"
 #include "Random.hpp"
-#include "BaseNode.hpp"
+#include "SkipListLevel.hpp"
 #include "Comparer.hpp"
 #include "Iterator.hpp"
+#include "BlockedBloomFilter.hpp"
+#include "HashValueIndex.hpp"
+#include "FrozenSkipList.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
 #include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
 #include "NonCopyable.hpp"
 
 namespace FclEx
@@ -16,272 +28,2038 @@ namespace FclEx
 		using namespace std;
 		using namespace Node;
 
-		template<typename TKey, typename TValue, typename Allocator>
-		class SkipListNode : public BaseNode<pair<TKey, TValue>, SkipListNode<TKey, TValue, Allocator>, Allocator>
+		// A key prefix policy maps a key to 64 bits that order like the keys wherever they differ,
+		// so a search only has to compare the keys themselves when the prefixes are equal.
+		struct NoKeyPrefix
+		{
+			static constexpr bool Enabled = false;
+
+			template<typename K>
+			static UInt64 Of(const K &)
+			{
+				return 0;
+			}
+		};
+
+		// The first 8 bytes of a string, big-endian and zero padded. Strings compare bytewise as unsigned chars,
+		// so a smaller prefix means a smaller string, and the prefix lives in the node instead of behind the string's pointer.
+		struct StringKeyPrefix
+		{
+			static constexpr bool Enabled = true;
+
+			static UInt64 Of(const char *data, SizeType size)
+			{
+				UInt64 prefix = 0;
+				for (SizeType i = 0; i < 8; ++i)
+				{
+					prefix = prefix << 8 | (i < size ? static_cast<unsigned char>(data[i]) : 0);
+				}
+				return prefix;
+			}
+
+			static UInt64 Of(const string &key)
+			{
+				return Of(key.data(), key.size());
+			}
+
+			static UInt64 Of(const char *key)
+			{
+				SizeType size = 0;
+				while (size < 8 && key[size] != '\0')
+				{
+					++size;
+				}
+				return Of(key, size);
+			}
+
+#ifdef FCLEX_HAS_STRING_VIEW
+			static UInt64 Of(string_view key)
+			{
+				return Of(key.data(), key.size());
+			}
+#endif
+		};
+
+		// The filter policy of a SkipList answers "definitely absent" for keys, so lookups of missing keys skip the search.
+		// NoKeyFilter keeps none; BlockedBloomFilter is the one to use for miss-heavy lookups.
+		struct NoKeyFilter
+		{
+			static constexpr bool Enabled = false;
+
+			template<typename K>
+			void Add(const K &) { }
+
+			template<typename K>
+			bool MayContain(const K &) const
+			{
+				return true;
+			}
+
+			void Removed(SizeType) { }
+
+			bool NeedsRebuild() const
+			{
+				return false;
+			}
+
+			void Reset(SizeType) { }
+
+			void Clear() { }
+		};
+
+		// The value index policy of a SkipList is told of every element added and removed and of every value handed out
+		// by reference, so it can answer ContainsValue and FindByValue without a walk. NoValueIndex keeps none;
+		// see HashValueIndex.
+		struct NoValueIndex
+		{
+			static constexpr bool Enabled = false;
+
+			template<typename K, typename V>
+			void Added(const K &, const V &) { }
+
+			template<typename K, typename V>
+			void Removed(const K &, const V &) { }
+
+			template<typename K, typename V>
+			void Changing(const K &, const V &) { }
+
+			void Clear() { }
+
+			template<typename V>
+			bool Contains(const V &) const
+			{
+				return false;
+			}
+
+			template<typename V, typename K>
+			void KeysOf(const V &, vector<K> &) const { }
+		};
+
+		// Prefixes are only cached where the comparer is known to order keys bytewise.
+		template<typename TKey, typename TLess>
+		struct SkipListKeyPrefix
+		{
+			using Type = NoKeyPrefix;
+		};
+
+		template<>
+		struct SkipListKeyPrefix<string, less<string>>
+		{
+			using Type = StringKeyPrefix;
+		};
+
+		template<>
+		struct SkipListKeyPrefix<string, less<>>
+		{
+			using Type = StringKeyPrefix;
+		};
+
+		// The prefix slot of a node; empty, and so free in the node's padding, when prefixes are not cached.
+		template<bool Enabled>
+		struct SkipListNodePrefix
+		{
+			UInt64 Get() const
+			{
+				return 0;
+			}
+
+			void Set(UInt64) { }
+		};
+
+		template<>
+		struct SkipListNodePrefix<true>
+		{
+			UInt64 Get() const
+			{
+				return _prefix;
+			}
+
+			void Set(UInt64 prefix)
+			{
+				_prefix = prefix;
+			}
+
+		private:
+			UInt64 _prefix = 0;
+		};
+
+		// Conflict policies of the SkipList set operations, called with the value kept in the list
+		// and the other list's value for the same key.
+		struct KeepExisting
+		{
+			template<typename T, typename U>
+			void operator()(T &, U &&) const { }
+		};
+
+		struct TakeIncoming
+		{
+			template<typename T, typename U>
+			void operator()(T &target, U &&source) const
+			{
+				target = forward<U>(source);
+			}
+		};
+
+		// Removal policy of SkipList::Difference: whether the element with a key of the other list is removed.
+		struct AlwaysRemove
+		{
+			template<typename T, typename U>
+			bool operator()(const T &, const U &) const
+			{
+				return true;
+			}
+		};
+
+		// A skip list node is allocated as one contiguous block: the key/value pair followed by
+		// a tower of Height() forward links, so a node costs a single allocation and visiting
+		// a level touches the same cache lines as the key being compared.
+		template<typename TKey, typename TValue, typename Allocator, bool CachePrefix = false>
+		class SkipListNode
+		{
+		public:
+
+			typedef Allocator									allocator_type;
+			typedef typename allocator_type::difference_type    difference_type;
+			typedef typename allocator_type::reference          reference;
+			typedef typename allocator_type::const_reference    const_reference;
+			typedef typename allocator_type::pointer            pointer;
+			typedef typename allocator_type::const_pointer      const_pointer;
+			typedef pair<TKey, TValue>							value_type;
+
+			using PNode = SkipListNode*;
+			using ItemType = pair<TKey, TValue>;
+
+			ItemType Item;
+			PNode Prev;		// The previous node at level 0; the head's is the last node.
+
+			template<typename ...Args>
+			static PNode Create(SizeType level, Args&&... args)
+			{
+				if (level <= 0) throw std::invalid_argument("level");
+				ByteAllocator allocator;
+				var memory = allocator.allocate(AllocationSize(level));
+				try
+				{
+					return ::new (static_cast<void*>(memory)) SkipListNode(level, forward<Args>(args)...);
+				}
+				catch (...)
+				{
+					allocator.deallocate(memory, AllocationSize(level));
+					throw;
+				}
+			}
+
+			static void Destroy(PNode node) noexcept
+			{
+				var size = AllocationSize(node->_height);
+				node->~SkipListNode();
+				ByteAllocator().deallocate(reinterpret_cast<char*>(node), size);
+			}
+
+			SkipListNode(const SkipListNode &) = delete;
+			SkipListNode& operator=(const SkipListNode &) = delete;
+
+			PNode& Next()
+			{
+				return NeighborNodes[0];
+			}
+
+			PNode Next() const
+			{
+				return NeighborNodes[0];
+			}
+
+			SizeType Height() const
+			{
+				return _height;
+			}
+
+			// The cached prefix of the key, see StringKeyPrefix.
+			UInt64 Prefix() const
+			{
+				return _prefix.Get();
+			}
+
+			void SetPrefix(UInt64 prefix)
+			{
+				_prefix.Set(prefix);
+			}
+
+			// Whether the element was removed lazily and the node waits to be unlinked, see SkipList::EnableLazyRemoval.
+			bool IsTombstone() const
+			{
+				return _tombstone;
+			}
+
+			void SetTombstone()
+			{
+				_tombstone = true;
+			}
+
+		private:
+
+			using ByteAllocator = typename allocator_traits<Allocator>::template rebind_alloc<char>;
+
+			SkipListNodePrefix<CachePrefix> _prefix;	// Next to the tower, which a search reads with it.
+			bool _tombstone;							// In the padding before the height, so nodes do not grow.
+			UInt32 _height;
+
+		public:
+
+			// Declared with one slot, but Create() allocates room for Height() slots.
+			PNode NeighborNodes[1];
+
+		private:
+
+			template<typename ...Args>
+			explicit SkipListNode(SizeType level, Args&&... args) :
+				Item(forward<Args>(args)...),
+				Prev(nullptr),
+				_tombstone(false),
+				_height(static_cast<UInt32>(level))
+			{
+				for (SizeType i = 0; i < level; ++i)
+				{
+					NeighborNodes[i] = nullptr;
+				}
+			}
+
+			~SkipListNode() = default;
+
+			static constexpr SizeType AllocationSize(SizeType level)
+			{
+				return sizeof(SkipListNode) + (level - 1) * sizeof(PNode);
+			}
+		};
+
+		template<typename TKey, typename TValue, typename Allocator, bool CachePrefix = false>
+		class SkipListIterator : public Node::Iterator<SkipListNode<TKey, TValue, Allocator, CachePrefix>, SkipListIterator<TKey, TValue, Allocator, CachePrefix>>
+		{
+		public:
+			using Iterator = Node::Iterator<SkipListNode<TKey, TValue, Allocator, CachePrefix>, SkipListIterator>;
+			using IteratorType = typename Iterator::self_type;
+			using NodeType = typename Iterator::node_type;
+			typedef bidirectional_iterator_tag iterator_category;
+
+			// The head is needed to step back from end().
+			SkipListIterator(NodeType *node, NodeType *head = null) :Iterator(node), _head(head) { }
+
+			NodeType *GetNode() const
+			{
+				return Iterator::_pNode;
+			}
+
+			// Tombstones are stepped over in both directions.
+			IteratorType &operator++() override
+			{
+				do
+				{
+					Iterator::_pNode = Iterator::_pNode->Next();
+				} while (Iterator::_pNode != null && Iterator::_pNode->IsTombstone());
+				return *this;
+			}
+
+			IteratorType operator++(int) override
+			{
+				IteratorType old(*this);
+				operator++();
+				return old;
+			}
+
+			IteratorType &operator--()
+			{
+				do
+				{
+					Iterator::_pNode = Iterator::_pNode == null ? _head->Prev : Iterator::_pNode->Prev;
+				} while (Iterator::_pNode->IsTombstone());
+				return *this;
+			}
+
+			IteratorType operator--(int)
+			{
+				IteratorType old(*this);
+				operator--();
+				return old;
+			}
+
+		private:
+			NodeType *_head;
+		};
+
+		template<typename TKey,
+			typename TValue,
+			typename TLess = less<TKey>,
+			typename Allocator = allocator<pair<TKey, TValue>>,
+			typename TFilter = NoKeyFilter,
+			typename TValueIndex = NoValueIndex>
+			class SkipList : IKeyValueCollection<TKey, TValue>, NonCopyable
 		{
 		public:
 
-			using BaseNode = BaseNode<pair<TKey, TValue>, SkipListNode, Allocator>;
-			using PNode = typename BaseNode::PNode;
+			using KeyPrefix = typename SkipListKeyPrefix<TKey, TLess>::Type;
+			using Node = SkipListNode<TKey, TValue, Allocator, KeyPrefix::Enabled>;
+			using PNode = typename Node::PNode;
+			using ItemType = typename Node::ItemType;
+			using Iterator = SkipListIterator<TKey, TValue, Allocator, KeyPrefix::Enabled>;
+			using ReverseIterator = reverse_iterator<Iterator>;
+
+			// Enables the lookups taking another key type, for transparent comparers.
+			template<typename K>
+			using EnableIfLookup = typename enable_if<IsTransparent<TLess>::value && !is_same<K, TKey>::value>::type;
+
+			// Owns an element taken out of a list by Extract. Insert links the node into any list of the same type
+			// without allocating or copying the element again; a handle still owning a node destroys it.
+			class NodeHandle
+			{
+			public:
+				NodeHandle() : _node(null) { }
+
+				NodeHandle(NodeHandle &&other) noexcept : _node(other._node)
+				{
+					other._node = null;
+				}
+
+				NodeHandle &operator=(NodeHandle &&other) noexcept
+				{
+					if (this != &other)
+					{
+						Reset();
+						_node = other._node;
+						other._node = null;
+					}
+					return *this;
+				}
+
+				~NodeHandle() noexcept
+				{
+					Reset();
+				}
+
+				bool Empty() const
+				{
+					return _node == null;
+				}
+
+				// The key may be changed before the node is inserted again.
+				TKey &Key() const
+				{
+					return _node->Item.first;
+				}
+
+				TValue &Value() const
+				{
+					return _node->Item.second;
+				}
+
+			private:
+				friend class SkipList;
+
+				PNode _node;
+
+				explicit NodeHandle(PNode node) : _node(node) { }
+
+				void Reset() noexcept
+				{
+					if (_node != null) Node::Destroy(_node);
+					_node = null;
+				}
+			};
+
+			// What AddRange and RemoveKeys did with their keys.
+			struct BatchResult
+			{
+				SizeType Inserted = 0;
+				SizeType Updated = 0;
+				SizeType Removed = 0;
+				SizeType Skipped = 0;	// Keys already present when not overwriting, or absent when removing
+			};
+
+			// The elements of a key range, as returned by Range().
+			class RangeView
+			{
+			public:
+				RangeView(Iterator first, Iterator last) : _first(first), _last(last) { }
+
+				Iterator begin() const
+				{
+					return _first;
+				}
+
+				Iterator end() const
+				{
+					return _last;
+				}
+
+				bool Empty() const
+				{
+					return _first == _last;
+				}
+
+			private:
+				Iterator _first;
+				Iterator _last;
+			};
+
+			Iterator begin()
+			{
+				return Iterator(SkipTombstones(_head->Next()), _head);
+			}
+
+			Iterator end()
+			{
+				return Iterator(_nil, _head);
+			}
+
+			Iterator begin() const
+			{
+				return Iterator(SkipTombstones(_head->Next()), _head);
+			}
+
+			Iterator end() const
+			{
+				return Iterator(_nil, _head);
+			}
+
+			ReverseIterator rbegin() const
+			{
+				return ReverseIterator(end());
+			}
+
+			ReverseIterator rend() const
+			{
+				return ReverseIterator(begin());
+			}
+
+			// The element with the key, or end().
+			Iterator Find(const TKey &key) const
+			{
+				return Iterator(FindNode(key), _head);
+			}
+
+			// The first element whose key is not less than the key.
+			Iterator lower_bound(const TKey &key) const
+			{
+				return Iterator(LowerBound(key, KeyPrefix::Of(key)), _head);
+			}
+
+			// The first element whose key is greater than the key.
+			Iterator upper_bound(const TKey &key) const
+			{
+				return Iterator(UpperBound(key), _head);
+			}
+
+			pair<Iterator, Iterator> equal_range(const TKey &key) const
+			{
+				return{ lower_bound(key), upper_bound(key) };
+			}
+
+			// Heterogeneous lookups: with a transparent comparer such as less<>, a SkipList<string, TValue, less<>>
+			// can be probed with a const char* (or string_view) without building a temporary string.
+			template<typename K, typename = EnableIfLookup<K>>
+			Iterator Find(const K &key) const
+			{
+				return Iterator(FindNode(key), _head);
+			}
+
+			template<typename K, typename = EnableIfLookup<K>>
+			bool ContainsKey(const K &key) const
+			{
+				return FindNode(key) != _nil;
+			}
+
+			template<typename K, typename = EnableIfLookup<K>>
+			Iterator lower_bound(const K &key) const
+			{
+				return Iterator(LowerBound(key, KeyPrefix::Of(key)), _head);
+			}
+
+			template<typename K, typename = EnableIfLookup<K>>
+			Iterator upper_bound(const K &key) const
+			{
+				return Iterator(UpperBound(key), _head);
+			}
+
+			template<typename K, typename = EnableIfLookup<K>>
+			pair<Iterator, Iterator> equal_range(const K &key) const
+			{
+				return{ lower_bound(key), upper_bound(key) };
+			}
+
+			// The elements with keys in [lo, hi), found in O(log n) and walked in O(k).
+			RangeView Range(const TKey &lo, const TKey &hi) const
+			{
+				var first = LowerBound(lo, KeyPrefix::Of(lo));
+				var last = _comparer.Less(lo, hi) ? LowerBound(hi, KeyPrefix::Of(hi)) : first;
+				return RangeView(Iterator(first, _head), Iterator(last, _head));
+			}
+
+			// Removes the element at the position and returns the one after it.
+			// The node is unlinked through the level 0 back links, without searching for its key.
+			Iterator erase(Iterator position)
+			{
+				var node = position.GetNode();
+				var next = SkipTombstones(node->Next());
+				Node::Destroy(Detach(node));
+				return Iterator(next, _head);
+			}
+
+			// Removes the elements with keys in [lo, hi) and returns how many were removed.
+			// Every level is relinked once past the range, so the cost is O(log n + k).
+			SizeType RemoveRange(const TKey &lo, const TKey &hi)
+			{
+				if (!_comparer.Less(lo, hi)) return 0;
+				FindPrevNodes(lo);
+
+				var first = _finger[0]->Next();
+				var prefix = KeyPrefix::Of(hi);
+				for (var i = 0; i < _listLevel; i++)
+				{
+					var next = _finger[i]->NeighborNodes[i];
+					while (next != _nil && Before(next, hi, prefix))
+					{
+						next = next->NeighborNodes[i];
+					}
+					_finger[i]->NeighborNodes[i] = next;
+				}
+
+				var last = _finger[0]->Next();
+				(last == _nil ? _head : last)->Prev = _finger[0];
+				SizeType removed = 0;
+				SizeType tombstones = 0;
+				for (var p = first; p != last;)
+				{
+					var q = p;
+					p = p->Next();
+					if (q->IsTombstone())
+					{
+						++tombstones;
+					}
+					else
+					{
+						++removed;
+						_valueIndex.Removed(q->Item.first, q->Item.second);
+					}
+					Node::Destroy(q);
+				}
+				_count -= removed;
+				_tombstones -= tombstones;
+				ShrinkLevel();
+				FilterRemoved(removed + tombstones);
+				return removed;
+			}
+
+			SkipList() :
+				SkipList(TFilter())
+			{
+			}
+
+			// Takes a configured filter, e.g. BlockedBloomFilter<TKey>(capacity, falsePositiveRate).
+			explicit SkipList(TFilter filter) :
+				_head(Node::Create(MaxLevel)),
+				_nil(null),
+				_filter(move(filter))
+			{
+				Initialize();
+			}
+
+			// Builds the list from a range sorted by key, see AssignSorted.
+			template<typename InputIterator>
+			SkipList(InputIterator first, InputIterator last) :
+				SkipList()
+			{
+				AssignSorted(first, last);
+			}
+
+			// Takes the nodes over from other, which is left empty. Unlike most moves this allocates a head and a default
+			// filter for other to keep, so it may throw bad_alloc and is not noexcept; move assignment only swaps.
+			SkipList(SkipList &&other) :
+				SkipList(TFilter())
+			{
+				operator=(move(other));
+			}
+
+			// Only the heads change owners, so no node is copied and no head is allocated: this list is cleared,
+			// and other is left empty with this list's old head, filter and value index.
+			SkipList &operator=(SkipList &&other)
+			{
+				if (&other == this) return *this;
+				Clear();
+				swap(_head, other._head);
+				swap(_listLevel, other._listLevel);
+				swap(_count, other._count);
+				swap(_finger, other._finger);
+				swap(_fingerValid, other._fingerValid);
+				swap(_tombstones, other._tombstones);
+				swap(_compactRatio, other._compactRatio);
+				swap(_filter, other._filter);
+				swap(_valueIndex, other._valueIndex);
+				return *this;
+			}
+
+			// Copies the list in one pass with every tower kept at its height. Nodes are appended in key order while
+			// the last node of each level is remembered, so each link is set once and no key is searched or compared.
+			SkipList Clone() const
+			{
+				SkipList clone(_filter);
+				clone._compactRatio = _compactRatio;
+				for (var p = SkipTombstones(_head->Next()); p != _nil; p = SkipTombstones(p->Next()))
+				{
+					clone.Append(Node::Create(p->Height(), p->Item));
+				}
+				return clone;
+			}
+
+			// A read-only copy in one contiguous array for lookup-only use, which searches without chasing pointers,
+			// see FrozenSkipList. The list itself is left as it is.
+			FrozenSkipList<TKey, TValue, TLess> Freeze() const
+			{
+				return FrozenSkipList<TKey, TValue, TLess>(begin(), end(), _count);
+			}
+
+			~SkipList() noexcept
+			{
+				var p = _head;
+				while (p != _nil)
+				{
+					var q = p;
+					p = p->Next();
+					Node::Destroy(q);
+				}
+				if(_nil != null) Node::Destroy(_nil);
+			}
+
+			SizeType Count() const override
+			{
+				return _count;
+			}
+
+			// The key filter, with its lookup counters.
+			const TFilter &Filter() const
+			{
+				return _filter;
+			}
+
+			TFilter &Filter()
+			{
+				return _filter;
+			}
+
+			void Add(const ItemType &item) override
+			{
+				if (!FindPrevNodes(item.first))
+				{
+					Insert(item, _finger, GetNewLevel());
+				}
+			}
+
+			void Add(ItemType &&item)
+			{
+				if (!FindPrevNodes(item.first))
+				{
+					Insert(move(item), _finger, GetNewLevel());
+				}
+			}
+
+			// Constructs the element in place from the arguments of a pair's constructor, unless its key exists.
+			// The node is built before the search, since the key is only known then; prefer TryEmplace to avoid that.
+			template<typename ...Args>
+			pair<Iterator, bool> Emplace(Args&&... args)
+			{
+				var node = Node::Create(GetNewLevel(), forward<Args>(args)...);
+				if (FindPrevNodes(node->Item.first))
+				{
+					Node::Destroy(node);
+					return{ Iterator(_finger[0]->Next(), _head), false };
+				}
+				Link(node, _finger);
+				return{ Iterator(node, _head), true };
+			}
+
+			// Constructs the value in place from the arguments if the key does not exist; otherwise nothing is moved from.
+			template<typename ...Args>
+			pair<Iterator, bool> TryEmplace(const TKey &key, Args&&... args)
+			{
+				return TryEmplaceKey(key, forward<Args>(args)...);
+			}
+
+			template<typename ...Args>
+			pair<Iterator, bool> TryEmplace(TKey &&key, Args&&... args)
+			{
+				return TryEmplaceKey(move(key), forward<Args>(args)...);
+			}
+
+			// Assigns the value to the element with the key, or inserts it; returns whether it was inserted.
+			template<typename M>
+			pair<Iterator, bool> InsertOrAssign(const TKey &key, M &&value)
+			{
+				return InsertOrAssignKey(key, forward<M>(value));
+			}
+
+			template<typename M>
+			pair<Iterator, bool> InsertOrAssign(TKey &&key, M &&value)
+			{
+				return InsertOrAssignKey(move(key), forward<M>(value));
+			}
+
+			// Unlinks the element with the key and hands its node over, or returns an empty handle.
+			NodeHandle Extract(const TKey &key)
+			{
+				if (!FindPrevNodes(key)) return NodeHandle();
+				var node = _finger[0]->Next();
+				Detach(node, _finger);
+				return NodeHandle(node);
+			}
+
+			NodeHandle Extract(Iterator position)
+			{
+				return NodeHandle(Detach(position.GetNode()));
+			}
+
+			// Links the handle's node in, keeping its height. If the key exists the handle keeps the node,
+			// and the element with the key is returned.
+			pair<Iterator, bool> Insert(NodeHandle &&handle)
+			{
+				if (handle.Empty()) return{ end(), false };
+				if (FindPrevNodes(handle.Key())) return{ Iterator(_finger[0]->Next(), _head), false };
+				var node = handle._node;
+				handle._node = null;
+				Link(node, _finger);
+				return{ Iterator(node, _head), true };
+			}
+
+			// Inserts the item unless its key exists, and returns the element with the key.
+			// The search starts at hint when it precedes the key, e.g. the previously inserted element
+			// when keys arrive in ascending order, and then costs O(log d) for a distance d from the hint.
+			Iterator Insert(Iterator hint, const ItemType &item)
+			{
+				var start = hint.GetNode();
+				var prefix = KeyPrefix::Of(item.first);
+				if (start == _nil || !Before(start, item.first, prefix))
+				{
+					if (FindPrevNodes(item.first)) return Iterator(_finger[0]->Next(), _head);
+					return Iterator(Insert(item, _finger, GetNewLevel()), _head);
+				}
+
+				PNode prevNodes[MaxLevel];
+				var levels = FindPrevNodes(start, item.first, prefix, prevNodes);
+				var next = prevNodes[0]->Next();
+				if (Matches(next, item.first, prefix))
+				{
+					// A tombstone with the key is unlinked by the search from the head.
+					if (next->IsTombstone()) return Insert(end(), item);
+					return Iterator(next, _head);
+				}
+
+				var newLevel = GetNewLevel();
+				if (newLevel > levels)
+				{
+					// The new node is taller than the part of the list seen from the hint; the upper links are found from the head.
+					var p = _head;
+					for (var i = _listLevel - 1; i >= levels; --i)
+					{
+						next = p->NeighborNodes[i];
+						while (next != _nil && Before(next, item.first, prefix))
+						{
+							p = next;
+							next = p->NeighborNodes[i];
+						}
+						prevNodes[i] = p;
+					}
+				}
+				// The finger may now skip over the new node.
+				_fingerValid = false;
+				return Iterator(Insert(item, prevNodes, newLevel), _head);
+			}
+
+			// Finds the element with the given key, starting at hint when it precedes the key.
+			Iterator Find(Iterator hint, const TKey &key) const
+			{
+				var start = hint.GetNode();
+				var prefix = KeyPrefix::Of(key);
+				if (start == _nil || !Before(start, key, prefix))
+				{
+					if (Matches(start, key, prefix)) return hint;
+					return Iterator(FindNode(key), _head);
+				}
+
+				PNode prevNodes[MaxLevel];
+				FindPrevNodes(start, key, prefix, prevNodes);
+				var next = prevNodes[0]->Next();
+				return Iterator(Matches(next, key, prefix) && !next->IsTombstone() ? next : _nil, _head);
+			}
+
+			void Clear() override
+			{
+				var p = _head->Next();
+				while (p != _nil)
+				{
+					var q = p;
+					p = p->Next();
+					Node::Destroy(q);
+				}
+				Initialize();
+			}
+
+			// Adds a batch of items, overwriting the values of existing keys if asked to. Every search continues from the finger
+			// left by the previous key, so items sorted by key cost O(log d) each for a distance d between consecutive keys,
+			// O(k log(n / k)) for the batch, instead of a descent from the head. Unsorted items are still added, only slower.
+			template<typename InputIterator>
+			BatchResult AddRange(InputIterator first, InputIterator last, bool overwrite = false)
+			{
+				BatchResult result;
+				for (; first != last; ++first)
+				{
+					const ItemType &item = *first;
+					if (overwrite)
+					{
+						if (InsertOrAssignKey(item.first, item.second).second) ++result.Inserted;
+						else ++result.Updated;
+					}
+					else
+					{
+						if (TryEmplaceKey(item.first, item.second).second) ++result.Inserted;
+						else ++result.Skipped;
+					}
+				}
+				return result;
+			}
+
+			// Removes a batch of keys, searching each from the finger left by the previous one like AddRange.
+			BatchResult RemoveKeys(const vector<TKey> &sortedKeys)
+			{
+				BatchResult result;
+				for (const var &key : sortedKeys)
+				{
+					if (FindPrevNodes(key))
+					{
+						Unlink(_finger[0]->Next(), _finger);
+						++result.Removed;
+					}
+					else
+					{
+						++result.Skipped;
+					}
+				}
+				return result;
+			}
+
+			// Replaces the content with a range sorted by key in one linear pass; of equal keys the first item is kept.
+			// Towers are assigned deterministically: the i-th node gets one extra level per trailing zero bit of i,
+			// which is the layout of a perfectly balanced skip list. Throws invalid_argument on unsorted input.
+			template<typename InputIterator>
+			void AssignSorted(InputIterator first, InputIterator last)
+			{
+				Clear();
+				// Nodes are appended at the tail, so the finger always holds the last node of each level.
+				for (UInt32 index = 1; first != last; ++first)
+				{
+					const ItemType &item = *first;
+					var tail = _finger[0];
+					if (tail != _head && !_comparer.Less(tail->Item.first, item.first))
+					{
+						if (_comparer.Equals(tail->Item.first, item.first)) continue;
+						Clear();
+						throw invalid_argument("first");
+					}
+
+					UInt32 level = 1;
+					for (var i = index++; (i & 1) == 0 && level < MaxLevel; i >>= 1)
+					{
+						++level;
+					}
+					Append(Node::Create(level, item));
+				}
+			}
+
+			// Moves the elements of other into this list, relinking its nodes instead of copying them; other is left empty.
+			// For a key in both lists, resolve(value, move(otherValue)) decides the value kept, see KeepExisting and TakeIncoming.
+			// Lists of similar size are merged in one pass over both; a much smaller other is inserted by finger searches,
+			// which gallop over the runs of this list between its keys.
+			template<typename TResolve = KeepExisting>
+			void MergeFrom(SkipList &other, TResolve resolve = TResolve())
+			{
+				if (&other == this) return;
+				other.Compact();
+				if (other._count * GallopRatio < _count)
+				{
+					while (other._count > 0)
+					{
+						var q = other._head->Next();
+						if (FindPrevNodes(q->Item.first))
+						{
+							var node = _finger[0]->Next();
+							_valueIndex.Changing(node->Item.first, node->Item.second);
+							resolve(node->Item.second, move(q->Item.second));
+							other.erase(Iterator(q, other._head));
+						}
+						else
+						{
+							Link(other.Detach(q), _finger);
+						}
+					}
+					return;
+				}
+
+				Compact();
+				var p = TakeAll();
+				var q = other.TakeAll();
+				try
+				{
+					while (q != _nil)
+					{
+						if (p != _nil && _comparer.Less(p->Item.first, q->Item.first))
+						{
+							p = AppendNext(p);
+						}
+						else if (p != _nil && !_comparer.Less(q->Item.first, p->Item.first))
+						{
+							resolve(p->Item.second, move(q->Item.second));
+							var next = q->Next();
+							Node::Destroy(q);
+							q = next;
+						}
+						else
+						{
+							q = AppendNext(q);
+						}
+					}
+				}
+				catch (...)
+				{
+					AppendAll(p);
+					other.AppendAll(q);
+					throw;
+				}
+				AppendAll(p);
+			}
+
+			// Adds copies of the elements of other whose keys are missing; for a key in both lists,
+			// resolve(value, otherValue) decides the value kept. Like MergeFrom, this is one merging pass or galloping.
+			template<typename TResolve = KeepExisting>
+			void Union(const SkipList &other, TResolve resolve = TResolve())
+			{
+				if (&other == this) return;
+				if (other._count * GallopRatio < _count)
+				{
+					for (var q = SkipTombstones(other._head->Next()); q != other._nil; q = SkipTombstones(q->Next()))
+					{
+						if (FindPrevNodes(q->Item.first))
+						{
+							var node = _finger[0]->Next();
+							_valueIndex.Changing(node->Item.first, node->Item.second);
+							resolve(node->Item.second, static_cast<const TValue&>(q->Item.second));
+						}
+						else
+						{
+							Insert(q->Item, _finger, GetNewLevel());
+						}
+					}
+					return;
+				}
+
+				Compact();
+				var p = TakeAll();
+				var q = SkipTombstones(other._head->Next());
+				try
+				{
+					for (; q != other._nil; q = SkipTombstones(q->Next()))
+					{
+						while (p != _nil && _comparer.Less(p->Item.first, q->Item.first))
+						{
+							p = AppendNext(p);
+						}
+						if (p != _nil && !_comparer.Less(q->Item.first, p->Item.first))
+						{
+							resolve(p->Item.second, static_cast<const TValue&>(q->Item.second));
+							p = AppendNext(p);
+						}
+						else
+						{
+							// The copy keeps the tower height of the original.
+							Append(Node::Create(q->Height(), q->Item));
+						}
+					}
+				}
+				catch (...)
+				{
+					AppendAll(p);
+					throw;
+				}
+				AppendAll(p);
+			}
+
+			// Removes the elements whose keys are not in other; for the others, resolve(value, otherValue) decides the value kept.
+			// Every element of this list is visited once, while other is searched forward from the previous match,
+			// so a much larger other costs O(log d) per key rather than a walk over all of it.
+			template<typename TResolve = KeepExisting>
+			void Intersect(const SkipList &other, TResolve resolve = TResolve())
+			{
+				if (&other == this) return;
+				Compact();
+				var p = TakeAll();
+				var before = other._head;
+				try
+				{
+					while (p != _nil)
+					{
+						var prefix = KeyPrefix::Of(p->Item.first);
+						before = other.SeekBefore(before, p->Item.first, prefix);
+						var q = before->Next();
+						if (other.Matches(q, p->Item.first, prefix) && !q->IsTombstone())
+						{
+							resolve(p->Item.second, static_cast<const TValue&>(q->Item.second));
+							p = AppendNext(p);
+						}
+						else
+						{
+							var next = p->Next();
+							Node::Destroy(p);
+							p = next;
+						}
+					}
+				}
+				catch (...)
+				{
+					AppendAll(p);
+					throw;
+				}
+			}
+
+			// Removes the elements whose keys are in other and for which remove(value, otherValue) holds, see AlwaysRemove.
+			// A much smaller other is removed by finger searches; otherwise this list is walked once
+			// and other searched forward from the previous match.
+			template<typename TRemove = AlwaysRemove>
+			void Difference(const SkipList &other, TRemove remove = TRemove())
+			{
+				if (&other == this)
+				{
+					Clear();
+					return;
+				}
+				if (other._count * GallopRatio < _count)
+				{
+					for (var q = SkipTombstones(other._head->Next()); q != other._nil; q = SkipTombstones(q->Next()))
+					{
+						if (FindPrevNodes(q->Item.first))
+						{
+							var node = _finger[0]->Next();
+							if (remove(static_cast<const TValue&>(node->Item.second), q->Item.second)) Unlink(node, _finger);
+						}
+					}
+					return;
+				}
+
+				Compact();
+				var p = TakeAll();
+				var before = other._head;
+				try
+				{
+					while (p != _nil)
+					{
+						var prefix = KeyPrefix::Of(p->Item.first);
+						before = other.SeekBefore(before, p->Item.first, prefix);
+						var q = before->Next();
+						if (other.Matches(q, p->Item.first, prefix) && !q->IsTombstone()
+							&& remove(static_cast<const TValue&>(p->Item.second), q->Item.second))
+						{
+							var next = p->Next();
+							Node::Destroy(p);
+							p = next;
+						}
+						else
+						{
+							p = AppendNext(p);
+						}
+					}
+				}
+				catch (...)
+				{
+					AppendAll(p);
+					throw;
+				}
+			}
+
+			// Moves the elements with keys not less than the key into upper, replacing its content.
+			// The towers are cut along the search path of the key, so the links cost O(log n); the counts of both lists
+			// are found by walking from the cut in both directions at once, which takes O(min(k, n - k)) for k moved elements.
+			// Tombstones are compacted first, O(n), and a filter or value index is updated for the moved elements, O(k).
+			void Split(const TKey &key, SkipList &upper)
+			{
+				if (&upper == this) throw invalid_argument("upper");
+				upper.Clear();
+				Compact();
+				FindPrevNodes(key);
+				var first = _finger[0]->Next();
+				if (first == _nil) return;
+
+				for (var i = 0; i < _listLevel; ++i)
+				{
+					upper._head->NeighborNodes[i] = _finger[i]->NeighborNodes[i];
+					_finger[i]->NeighborNodes[i] = _nil;
+				}
+				upper._head->Prev = _head->Prev;
+				first->Prev = upper._head;
+				_head->Prev = _finger[0];
+				upper._listLevel = _listLevel;
+				upper._compactRatio = _compactRatio;
+				upper.ShrinkLevel();
+				ShrinkLevel();
+
+				SizeType moved = 0;
+				SizeType kept = 0;
+				for (PNode p = first, q = _finger[0];; p = p->Next(), q = q->Prev)
+				{
+					if (p == _nil) break;
+					++moved;
+					if (q == _head)
+					{
+						moved = _count - kept;
+						break;
+					}
+					++kept;
+				}
+				upper._count = static_cast<UInt32>(moved);
+				_count -= static_cast<UInt32>(moved);
+				if (TValueIndex::Enabled)
+				{
+					for (var p = first; p != _nil; p = p->Next())
+					{
+						_valueIndex.Removed(p->Item.first, p->Item.second);
+						upper._valueIndex.Added(p->Item.first, p->Item.second);
+					}
+				}
+				// The filter of upper has to learn the moved keys; the ones left in this filter only cost false positives.
+				if (TFilter::Enabled) upper.RebuildFilter();
+				FilterRemoved(moved);
+			}
+
+			// Moves all elements of other into this list when the key ranges of the two do not overlap,
+			// whichever of them holds the smaller keys. Only the links along the last nodes of the front list's levels change,
+			// so this is O(log n) for lists without tombstones, filter or value index. Tombstones in either list are compacted
+			// first, O(n + m) for m elements in other, and a filter or value index learns every key of other, O(m).
+			// Throws invalid_argument when the ranges overlap.
+			void Join(SkipList &other)
+			{
+				if (&other == this || other._count == 0) return;
+				Compact();
+				other.Compact();
+				PNode lasts[MaxLevel];
+				if (_count == 0 || _comparer.Less(_head->Prev->Item.first, other._head->Next()->Item.first))
+				{
+					LastNodes(lasts);
+					for (var i = 0; i < other._listLevel; ++i)
+					{
+						(i < _listLevel ? lasts[i] : _head)->NeighborNodes[i] = other._head->NeighborNodes[i];
+					}
+					other._head->Next()->Prev = _head->Prev;
+					_head->Prev = other._head->Prev;
+				}
+				else if (_comparer.Less(other._head->Prev->Item.first, _head->Next()->Item.first))
+				{
+					other.LastNodes(lasts);
+					for (var i = 0; i < other._listLevel; ++i)
+					{
+						lasts[i]->NeighborNodes[i] = _head->NeighborNodes[i];
+						_head->NeighborNodes[i] = other._head->NeighborNodes[i];
+					}
+					_head->Next()->Prev = _head;
+					lasts[0]->Next()->Prev = lasts[0];
+				}
+				else
+				{
+					throw invalid_argument("other");
+				}
+
+				if (other._listLevel > _listLevel) _listLevel = other._listLevel;
+				if (TFilter::Enabled || TValueIndex::Enabled)
+				{
+					var p = other._head->Next();
+					for (SizeType i = 0; i < other._count; ++i, p = p->Next())
+					{
+						_filter.Add(p->Item.first);
+						_valueIndex.Added(p->Item.first, p->Item.second);
+					}
+				}
+				_count += other._count;
+				if (_filter.NeedsRebuild()) RebuildFilter();
+				// Finger entries above the old level are stale.
+				_fingerValid = false;
+				other.Initialize();
+			}
+
+			bool Contains(const ItemType &item) const override
+			{
+				var node = FindNode(item.first);
+				return node != null && _valueComparer.Equals(node->Item.second, item.second);
+			}
+
+			bool Remove(const ItemType &item) override
+			{
+				return Remove(item.first, true, item.second);
+			}
+
+			//// index-get
+			const TValue& operator[](const TKey& key) const override
+			{
+				auto node = FindNode(key);
+				return node == null ? _defaultValue : node->Item.second;
+			}
+
+			//// index-set
+			TValue& operator[](const TKey& key) override
+			{
+				var node = FindPrevNodes(key)
+					? _finger[0]->Next()
+					: Insert(_finger, GetNewLevel(), piecewise_construct, forward_as_tuple(key), forward_as_tuple());
+				// The caller may assign through the reference.
+				_valueIndex.Changing(node->Item.first, node->Item.second);
+				return node->Item.second;
+			}
+
+			void Add(const TKey& key, const TValue& value) override
+			{
+				Add(ItemType(key, value));
+			}
+
+			bool ContainsKey(const TKey& key) const override 
+			{ 
+				return FindNode(key) != null; 
+			}
+
+			bool ContainsValue(const TValue& value) const override 
+			{ 
+				if (TValueIndex::Enabled) return _valueIndex.Contains(value);
+				for(const auto &item : *this)
+				{
+					if(_valueComparer.Equals(item.second, value))
+					{
+						return true;
+					}
+				}
+				return false;
+			}
+
+			// The keys of the elements holding the value: in key order from a walk, or in no particular order from the value index.
+			vector<TKey> FindByValue(const TValue &value) const
+			{
+				vector<TKey> keys;
+				if (TValueIndex::Enabled)
+				{
+					_valueIndex.KeysOf(value, keys);
+					return keys;
+				}
+				for (const auto &item : *this)
+				{
+					if (_valueComparer.Equals(item.second, value)) keys.push_back(item.first);
+				}
+				return keys;
+			}
+
+			// The value index follows Add, Remove, operator[] and the other members; values changed through iterators
+			// are only seen after this rebuild.
+			void RebuildValueIndex()
+			{
+				_valueIndex.Clear();
+				for (var p = SkipTombstones(_head->Next()); p != _nil; p = SkipTombstones(p->Next()))
+				{
+					_valueIndex.Added(p->Item.first, p->Item.second);
+				}
+			}
+
+			bool Remove(const TKey& key) override
+			{ 
+				return Remove(key, false);
+			}
+
+			// Looks up all keys, writing the element of each (or end()) to out in the same order.
+			// Up to BatchSize searches advance in lockstep, each prefetching the node it compares next,
+			// so their cache misses overlap instead of being paid one after another.
+			void FindMany(const vector<TKey> &keys, vector<Iterator> &out) const
+			{
+				out.clear();
+				out.reserve(keys.size());
+				PNode nodes[BatchSize];
+				for (SizeType i = 0; i < keys.size(); i += BatchSize)
+				{
+					var count = keys.size() - i < BatchSize ? keys.size() - i : BatchSize;
+					FindBatch(&keys[i], count, nodes);
+					for (SizeType j = 0; j < count; ++j)
+					{
+						out.push_back(Iterator(nodes[j], _head));
+					}
+				}
+			}
+
+			void ContainsKeyMany(const vector<TKey> &keys, vector<bool> &out) const
+			{
+				out.clear();
+				out.reserve(keys.size());
+				PNode nodes[BatchSize];
+				for (SizeType i = 0; i < keys.size(); i += BatchSize)
+				{
+					var count = keys.size() - i < BatchSize ? keys.size() - i : BatchSize;
+					FindBatch(&keys[i], count, nodes);
+					for (SizeType j = 0; j < count; ++j)
+					{
+						out.push_back(nodes[j] != _nil);
+					}
+				}
+			}
+
+			// Makes Remove only mark the element's node as a tombstone, which lookups and iteration step over, instead of
+			// unlinking and destroying it. Once tombstones make up more than compactRatio of the nodes, Compact unlinks them
+			// all in one pass. Adding a key that has a tombstone unlinks the tombstone first; operations relinking the
+			// whole list, like Split, Join and the merging set operations, compact first.
+			void EnableLazyRemoval(double compactRatio = 0.25)
+			{
+				if (!(compactRatio > 0 && compactRatio <= 1)) throw invalid_argument("compactRatio");
+				_compactRatio = compactRatio;
+			}
+
+			void DisableLazyRemoval()
+			{
+				_compactRatio = 0;
+				Compact();
+			}
+
+			// The lazily removed nodes not unlinked yet; Count() leaves them out.
+			SizeType Tombstones() const
+			{
+				return _tombstones;
+			}
 
-			explicit SkipListNode(SizeType level) : SkipListNode(level, ItemType(default(TKey), default(TValue))) { }
+			// Unlinks and destroys all tombstones in one pass over level 0, appending every other node after
+			// the last node seen at each level of its tower.
+			void Compact()
+			{
+				if (_tombstones == 0) return;
+				PNode lasts[MaxLevel];
+				for (var &last : lasts)
+				{
+					last = _head;
+				}
+				for (var p = _head->Next(); p != _nil;)
+				{
+					var next = p->Next();
+					if (p->IsTombstone())
+					{
+						Node::Destroy(p);
+					}
+					else
+					{
+						p->Prev = lasts[0];
+						for (var i = 0; i < static_cast<Int32>(p->Height()); ++i)
+						{
+							lasts[i]->NeighborNodes[i] = p;
+							lasts[i] = p;
+						}
+					}
+					p = next;
+				}
+				for (var i = 0; i < _listLevel; ++i)
+				{
+					lasts[i]->NeighborNodes[i] = _nil;
+				}
+				_head->Prev = lasts[0];
+				var tombstones = _tombstones;
+				_tombstones = 0;
+				ShrinkLevel();
+				// The finger may hold destroyed nodes.
+				for (var &node : _finger)
+				{
+					node = _head;
+				}
+				FilterRemoved(tombstones);
+			}
 
-			explicit SkipListNode(SizeType level, pair<TKey, TValue> item) : BaseNode(item, level) { }
+			// Splits the list into up to parts ranges of about equal size, in key order, without walking the list.
+			// The nodes of a level are a random sample of the list, so the highest level with SamplesPerRange nodes
+			// per range is walked and cut into runs of equal length; the levels above it hold about as many nodes again.
+			vector<RangeView> Partition(SizeType parts) const
+			{
+				vector<RangeView> ranges;
+				if (_count == 0 || parts == 0) return ranges;
+				vector<PNode> towers;
+				for (var i = _listLevel - 1; i >= 0; --i)
+				{
+					towers.clear();
+					for (var p = _head->NeighborNodes[i]; p != _nil; p = p->NeighborNodes[i])
+					{
+						towers.push_back(p);
+					}
+					if (towers.size() >= parts * SamplesPerRange) break;
+				}
+				if (parts > towers.size()) parts = towers.size();
 
-			explicit SkipListNode(SizeType level, TKey key, TValue value) : SkipListNode(level, pair<TKey, TValue>(key, value)) { }
-			
-			PNode& Next = BaseNode::_neighborNodes[0];
+				var first = SkipTombstones(_head->Next());
+				for (SizeType j = 1; j <= parts; ++j)
+				{
+					var last = j < parts ? SkipTombstones(towers[j * towers.size() / parts]) : _nil;
+					if (last == first) continue;
+					ranges.push_back(RangeView(Iterator(first, _head), Iterator(last, _head)));
+					first = last;
+				}
+				return ranges;
+			}
 
-			SizeType Height() const
+			// Calls fn(item) for every element on up to threads threads, 0 for one per core; each thread scans
+			// the ranges of Partition it takes. The elements must not be added or removed meanwhile; the values may be
+			// changed by fn, as through an iterator. The first exception thrown by fn is rethrown once all threads finish.
+			template<typename TFunc>
+			void ParallelForEach(TFunc fn, SizeType threads = 0) const
 			{
-				return BaseNode::NeighborNodesNum();
+				ParallelRun(threads, [&fn](const RangeView &range, SizeType)
+				{
+					for (var &item : range)
+					{
+						fn(item);
+					}
+				});
 			}
-		};
 
-		template<typename TKey, typename TValue, typename Allocator>
-		class SkipListIterator : public Iterator<SkipListNode<TKey, TValue, Allocator>, SkipListIterator<TKey, TValue, Allocator>>
-		{
-		public:
-			using Iterator = Iterator<SkipListNode<TKey, TValue, Allocator>, SkipListIterator>;
-			using IteratorType = typename Iterator::self_type;
-			using NodeType = typename Iterator::node_type;
+			// Folds combine(result, map(item)) over the elements like ParallelForEach, starting each range from identity.
+			// The results of the ranges are combined in key order, so combine needs to be associative but not commutative.
+			template<typename T, typename TMap, typename TCombine>
+			T ParallelReduce(T identity, TMap map, TCombine combine, SizeType threads = 0) const
+			{
+				vector<PartialResult<T>> results;
+				ParallelRun(threads, [&](const RangeView &range, SizeType index)
+				{
+					var result = identity;
+					for (var &item : range)
+					{
+						result = combine(move(result), map(item));
+					}
+					results[index].Value = move(result);
+				}, &results, identity);
+				var result = identity;
+				for (var &partial : results)
+				{
+					result = combine(move(result), move(partial.Value));
+				}
+				return result;
+			}
 
-			SkipListIterator(NodeType *node) :Iterator(node) { }
+		private:
 
-			IteratorType &operator++() override
+			static constexpr UInt32 MaxLevel = 32;			// Maximum level any node in a skip list can have
+			static constexpr double Probability = 0.5;		// Probability factor used to determine the node level
+			static constexpr SizeType BatchSize = 16;		// Number of searches FindMany interleaves
+			static constexpr SizeType GallopRatio = 8;		// Set operations search instead of merging when one list is this many times smaller
+			static constexpr SizeType RangesPerThread = 4;	// Parallel scans split the list finer than the threads, to even out their loads
+			static constexpr SizeType SamplesPerRange = 32;	// Tower nodes Partition counts per range; ranges vary by about 1 / sqrt of it
+			PNode _head;									// The skip list header.
+			const PNode _nil;								//  NIL node.
+
+			Int32 _listLevel;								// Current maximum list level.
+			UInt32 _count;									// Current number of elements in the skip list.
+			const TValue _defaultValue = default(TValue);
+			const Comparer<TKey, TLess> _comparer;
+			const Comparer<TValue> _valueComparer;
+			const Random _random;
+			TFilter _filter;								// Rejects lookups of absent keys before the search.
+			TValueIndex _valueIndex;						// Maps values back to their keys.
+			SizeType _tombstones;							// Lazily removed nodes still linked
+			double _compactRatio = 0;						// The share of tombstones that triggers Compact, or 0 to remove eagerly
+
+			// The search path of the last update: _finger[i] is the last node before its key at level i.
+			// Updates near the previous one start from here instead of from the head.
+			PNode _finger[MaxLevel];
+			bool _fingerValid;
+
+			Int32 GetNewLevel() const
 			{
-				Iterator::_pNode = Iterator::_pNode->Next;
-				return *this;
+				return NewLevel(_random, _listLevel, MaxLevel, Probability);
 			}
 
-			IteratorType operator++(int) override
+			// Whether the node's key is less than the key, whose prefix is given.
+			// Differing prefixes decide without reading the node's key.
+			template<typename K>
+			bool Before(PNode node, const K &key, UInt64 prefix) const
 			{
-				IteratorType old(*this);
-				Iterator::_pNode = Iterator::_pNode->Next;
-				return old;
+				if (KeyPrefix::Enabled && node->Prefix() != prefix) return node->Prefix() < prefix;
+				return _comparer.Less(node->Item.first, key);
 			}
-		};
-
-		template<typename TKey,
-			typename TValue,
-			typename TLess = less<TKey>,
-			typename Allocator = allocator<pair<TKey, TValue>>>
-			class SkipList : IKeyValueCollection<TKey, TValue>, NonCopyable
-		{
-		public:
 
-			using Node = SkipListNode<TKey, TValue, Allocator>;
-			using PNode = typename Node::PNode;
-			using ItemType = typename Node::ItemType;
-			using Iterator = SkipListIterator<TKey, TValue, Allocator>;
+			// Whether the node holds the key. The node must not be before the key,
+			// so one comparison the other way round decides.
+			template<typename K>
+			bool Matches(PNode node, const K &key, UInt64 prefix) const
+			{
+				if (node == _nil || (KeyPrefix::Enabled && node->Prefix() != prefix)) return false;
+				return !_comparer.Less(key, node->Item.first);
+			}
 
-			Iterator begin()
+			template<typename K>
+			PNode FindNode(const K &key) const
 			{
-				return Iterator(_head->Next);
+				if (!_filter.MayContain(key)) return null;
+				var prefix = KeyPrefix::Of(key);
+				PNode p;
+				for (var i = FingerStart(key, prefix, p); i >= 0; --i)
+				{
+					var next = p->NeighborNodes[i];
+					while (next != _nil && Before(next, key, prefix))
+					{
+						p = next; // Move forward in the skip list.
+						next = p->NeighborNodes[i];
+					}
+					if (Matches(next, key, prefix)) return next->IsTombstone() ? null : next;
+				}
+				return null;
 			}
 
-			Iterator end()
+			PNode Insert(const ItemType &item, PNode *prevNodes, Int32 newLevel)
 			{
-				return Iterator(_nil);
+				return Insert(prevNodes, newLevel, item);
 			}
 
-			Iterator begin() const
+			PNode Insert(ItemType &&item, PNode *prevNodes, Int32 newLevel)
 			{
-				return Iterator(_head->Next);
+				return Insert(prevNodes, newLevel, move(item));
 			}
 
-			Iterator end() const
+			// Constructs a node from the arguments and links it after prevNodes.
+			template<typename ...Args>
+			PNode Insert(PNode *prevNodes, Int32 newLevel, Args&&... args)
 			{
-				return Iterator(_nil);
+				var newNode = Node::Create(newLevel, forward<Args>(args)...);
+				Link(newNode, prevNodes);
+				return newNode;
 			}
 
-			SkipList() :
-				_head(new Node(MaxLevel)),
-				_nil(null)
+			template<typename K, typename ...Args>
+			pair<Iterator, bool> TryEmplaceKey(K &&key, Args&&... args)
 			{
-				Initialize();
+				if (FindPrevNodes(key)) return{ Iterator(_finger[0]->Next(), _head), false };
+				var node = Insert(_finger, GetNewLevel(), piecewise_construct,
+					forward_as_tuple(forward<K>(key)), forward_as_tuple(forward<Args>(args)...));
+				return{ Iterator(node, _head), true };
 			}
 
-			~SkipList() noexcept
+			template<typename K, typename M>
+			pair<Iterator, bool> InsertOrAssignKey(K &&key, M &&value)
 			{
-				var p = _head;
-				while (p != _nil)
+				if (FindPrevNodes(key))
 				{
-					var q = p;
-					p = p->Next;
-					delete q;
+					var node = _finger[0]->Next();
+					_valueIndex.Changing(node->Item.first, node->Item.second);
+					node->Item.second = forward<M>(value);
+					return{ Iterator(node, _head), false };
 				}
-				if(_nil != null) delete _nil;
+				var node = Insert(_finger, GetNewLevel(), forward<K>(key), forward<M>(value));
+				return{ Iterator(node, _head), true };
 			}
 
-			SizeType Count() const override
+			// Links a node that belongs to no list after prevNodes, at every level of its height.
+			void Link(PNode newNode, PNode *prevNodes)
 			{
-				return _count;
+				var newLevel = static_cast<Int32>(newNode->Height());
+				newNode->SetPrefix(KeyPrefix::Of(newNode->Item.first));
+				if (newLevel > _listLevel)
+				{
+					// Make sure our update references above the current skip list level point to the header. 
+					for (var i = _listLevel; i < newLevel; ++i)
+					{
+						prevNodes[i] = _head;
+					}
+					_listLevel = newLevel; // The current skip list level is now the new node level.
+				}
+				for (var i = 0; i < newLevel; ++i)
+				{
+					// The new node next references are initialized to point to our update next references which point to nodes further along in the skip list.
+					newNode->NeighborNodes[i] = prevNodes[i]->NeighborNodes[i];
+					// Take our update next references and point them towards the new node. 
+					prevNodes[i]->NeighborNodes[i] = newNode;
+				}
+				newNode->Prev = prevNodes[0];
+				var next = newNode->Next();
+				(next == _nil ? _head : next)->Prev = newNode;
+				++_count;
+				_filter.Add(newNode->Item.first);
+				if (_filter.NeedsRebuild()) RebuildFilter();
+				_valueIndex.Added(newNode->Item.first, newNode->Item.second);
 			}
 
-			void Add(const ItemType &item) override
+			// Picks the node and level a search for the key starts from.
+			// Following Pugh's finger search, the finger is climbed only as far as needed to pass (or get back before) the key,
+			// so a key at distance d from the previous update is found in O(log d) rather than O(log n).
+			template<typename K>
+			Int32 FingerStart(const K &key, UInt64 prefix, PNode &start) const
 			{
-				pair<vector<PNode>, bool> prevNodes = FindPrevNodes(item.first);
-				if (!prevNodes.second)
+				var level = 0;
+				if (_fingerValid)
 				{
-					Insert(item, prevNodes.first);
+					if (_finger[0] == _head || Before(_finger[0], key, prefix))
+					{
+						// The key lies ahead: climb while the finger's successor one level up is still before the key.
+						while (level + 1 < _listLevel)
+						{
+							var next = _finger[level + 1]->NeighborNodes[level + 1];
+							if (next == _nil || !Before(next, key, prefix)) break;
+							++level;
+						}
+						start = _finger[level];
+						return level;
+					}
+					// The key lies behind: climb until the finger node precedes the key.
+					while (level < _listLevel && _finger[level] != _head && !Before(_finger[level], key, prefix))
+					{
+						++level;
+					}
+					if (level < _listLevel)
+					{
+						start = _finger[level];
+						return level;
+					}
 				}
+				start = _head;
+				return _listLevel - 1;
 			}
 
-			void Clear() override
+			// Fills the finger with the nodes before the key at every level and returns whether the key exists.
+			bool FindPrevNodes(const TKey &key)
 			{
-				var p = _head->Next;
-				while (p != _nil)
+				var prefix = KeyPrefix::Of(key);
+				PNode p;
+				for (var i = FingerStart(key, prefix, p); i >= 0; i--)
 				{
-					var q = p;
-					p = p->Next;
-					delete q;
+					var next = p->NeighborNodes[i];
+					while (next != _nil && Before(next, key, prefix))
+					{
+						p = next; // Move forward in the skip list.
+						next = p->NeighborNodes[i];
+					}
+					_finger[i] = p;
 				}
-				Initialize();
+				_fingerValid = true;
+				var next = p->Next();
+				if (!Matches(next, key, prefix)) return false;
+				if (!next->IsTombstone()) return true;
+				// The key was removed lazily: its node goes now, and the key is missing.
+				Unlink(next, _finger);
+				return false;
 			}
 
-			bool Contains(const ItemType &item) const override
+			// Searches forward from start, which must precede the key, climbing on the towers met on the way.
+			// Fills prevNodes below the height of the node the search descends from, and returns that height.
+			Int32 FindPrevNodes(PNode start, const TKey &key, UInt64 prefix, PNode *prevNodes) const
 			{
-				return Find(item.first) == null;
-			}
+				var p = start;
+				var level = 0;
+				for (;;)
+				{
+					var up = level + 1 < static_cast<Int32>(p->Height()) ? p->NeighborNodes[level + 1] : _nil;
+					if (up != _nil && Before(up, key, prefix))
+					{
+						++level;
+						continue;
+					}
+					var next = p->NeighborNodes[level];
+					if (next == _nil || !Before(next, key, prefix)) break;
+					p = next;
+				}
 
-			bool Remove(const ItemType &item) override
-			{
-				return Remove(item.first, true, item.second);
+				// Every link of p from this level up already reaches the key.
+				var height = static_cast<Int32>(p->Height());
+				for (var i = height - 1; i > level; --i)
+				{
+					prevNodes[i] = p;
+				}
+				for (var i = level; i >= 0; --i)
+				{
+					var next = p->NeighborNodes[i];
+					while (next != _nil && Before(next, key, prefix))
+					{
+						p = next;
+						next = p->NeighborNodes[i];
+					}
+					prevNodes[i] = p;
+				}
+				return height;
 			}
 
-			//// index-get
-			const TValue& operator[](const TKey& key) const override
+			// The result of one range of ParallelReduce. Wrapped so that results of type bool are not packed into
+			// bits, which the threads would race on.
+			template<typename T>
+			struct PartialResult
 			{
-				auto node = Find(key);
-				return node == null ? _defaultValue : node->Item.second;
-			}
+				T Value;
+			};
 
-			//// index-set
-			TValue& operator[](const TKey& key) override
+			// Runs scan(range, index) over the ranges of Partition on the calling thread and up to threads - 1 more,
+			// each taking the next range not yet taken. results, if given, is sized to the ranges first.
+			template<typename TScan, typename T = bool>
+			void ParallelRun(SizeType threads, TScan scan, vector<PartialResult<T>> *results = null, const T &initial = T()) const
 			{
-				pair<vector<PNode>, bool> prevNodes = FindPrevNodes(key);
-				if (prevNodes.second)
+				if (threads == 0) threads = thread::hardware_concurrency();
+				if (threads == 0) threads = 1;
+				var ranges = Partition(threads * RangesPerThread);
+				if (results != null) results->assign(ranges.size(), PartialResult<T>{ initial });
+				if (threads > ranges.size()) threads = ranges.size();
+
+				atomic<SizeType> next(0);
+				exception_ptr error;
+				atomic<bool> failed(false);
+				var work = [&]()
+				{
+					try
+					{
+						for (var i = next++; i < ranges.size() && !failed; i = next++)
+						{
+							scan(ranges[i], i);
+						}
+					}
+					catch (...)
+					{
+						// Only the first failure is kept; the other threads stop at their next range.
+						if (!failed.exchange(true)) error = current_exception();
+					}
+				};
+
+				vector<thread> workers;
+				try
 				{
-					return prevNodes.first[0]->Next->Item.second;
+					for (SizeType i = 1; i < threads; ++i)
+					{
+						workers.emplace_back(work);
+					}
 				}
-				else
+				catch (...)
+				{
+					// Threads that could not be started leave their ranges to the others.
+				}
+				work();
+				for (var &worker : workers)
 				{
-					var node = Insert(ItemType(key, default(TValue)), prevNodes.first);
-					return node->Item.second;
+					worker.join();
 				}
+				if (error != null) rethrow_exception(error);
 			}
 
-			void Add(const TKey& key, const TValue& value) override
+			// Runs count (at most BatchSize) searches from the head in lockstep and stores the node found for each key, or _nil.
+			// Every step compares against a node whose line was prefetched one round earlier.
+			void FindBatch(const TKey *keys, SizeType count, PNode *nodes) const
 			{
-				Add(ItemType(key, value));
-			}
+				struct Search
+				{
+					PNode Prev;
+					PNode Next;
+					Int32 Level;	// Negative once the search has finished
+				};
 
-			bool ContainsKey(const TKey& key) const override 
-			{ 
-				return Find(key) == null; 
+				Search searches[BatchSize];
+				UInt64 prefixes[BatchSize];
+				var top = _listLevel - 1;
+				var active = count;
+				for (SizeType j = 0; j < count; ++j)
+				{
+					nodes[j] = _nil;
+					if (!_filter.MayContain(keys[j]))
+					{
+						searches[j].Level = -1;
+						--active;
+						continue;
+					}
+					searches[j] = Search{ _head, _head->NeighborNodes[top], top };
+					prefixes[j] = KeyPrefix::Of(keys[j]);
+					PREFETCH(searches[j].Next);
+				}
+
+				while (active > 0)
+				{
+					for (SizeType j = 0; j < count; ++j)
+					{
+						var &search = searches[j];
+						if (search.Level < 0) continue;
+
+						var next = search.Next;
+						if (next != _nil && Before(next, keys[j], prefixes[j]))
+						{
+							search.Prev = next;
+						}
+						else if (Matches(next, keys[j], prefixes[j]))
+						{
+							if (!next->IsTombstone()) nodes[j] = next;
+							search.Level = -1;
+							--active;
+							continue;
+						}
+						else if (search.Level-- == 0)
+						{
+							--active;
+							continue;
+						}
+						search.Next = search.Prev->NeighborNodes[search.Level];
+						PREFETCH(search.Next);
+					}
+				}
 			}
 
-			bool ContainsValue(const TValue& value) const override 
-			{ 
-				for(const auto &item : *this)
+			// The first node whose key is not less than the key.
+			template<typename K>
+			PNode LowerBound(const K &key, UInt64 prefix) const
+			{
+				PNode p;
+				for (var i = FingerStart(key, prefix, p); i >= 0; --i)
 				{
-					if(_valueComparer.Equals(item.second, value))
+					var next = p->NeighborNodes[i];
+					while (next != _nil && Before(next, key, prefix))
 					{
-						return false;
+						p = next;
+						next = p->NeighborNodes[i];
 					}
 				}
-				return true;
+				return SkipTombstones(p->Next());
 			}
 
-			bool Remove(const TKey& key) override
-			{ 
-				return Remove(key, false);
+			// The first node whose key is greater than the key.
+			template<typename K>
+			PNode UpperBound(const K &key) const
+			{
+				var prefix = KeyPrefix::Of(key);
+				var node = LowerBound(key, prefix);
+				return Matches(node, key, prefix) ? SkipTombstones(node->Next()) : node;
 			}
 
-		private:
+			void Unlink(PNode node, PNode *prevNodes)
+			{
+				Detach(node, prevNodes);
+				Node::Destroy(node);
+			}
 
-			static constexpr UInt32 MaxLevel = 32;			// Maximum level any node in a skip list can have
-			static constexpr double Probability = 0.5;		// Probability factor used to determine the node level
-			const PNode _head;								// The skip list header.
-			const PNode _nil;								//  NIL node.
+			// Takes the node out of the list without destroying it.
+			void Detach(PNode node, PNode *prevNodes)
+			{
+				for (var i = 0; i < static_cast<Int32>(node->Height()); i++)
+				{
+					prevNodes[i]->NeighborNodes[i] = node->NeighborNodes[i];
+				}
+				var next = node->Next();
+				(next == _nil ? _head : next)->Prev = node->Prev;
+				if (node->IsTombstone())
+				{
+					--_tombstones;
+				}
+				else
+				{
+					--_count;
+					_valueIndex.Removed(node->Item.first, node->Item.second);
+				}
+				ShrinkLevel();
+				FilterRemoved(1);
+			}
 
-			Int32 _listLevel;								// Current maximum list level.
-			UInt32 _count;									// Current number of elements in the skip list.
-			const TValue _defaultValue = default(TValue);
-			const Comparer<TKey, TLess> _comparer;
-			const Comparer<TValue> _valueComparer;
-			const Random _random;
+			// Takes the node out through the level 0 back links, without searching for its key.
+			PNode Detach(PNode node)
+			{
+				// The node before it at level i is the nearest earlier node taller than i.
+				PNode prevNodes[MaxLevel];
+				var height = static_cast<Int32>(node->Height());
+				var p = node->Prev;
+				for (var i = 0; i < height; ++i)
+				{
+					while (static_cast<Int32>(p->Height()) <= i)
+					{
+						p = p->Prev;
+					}
+					prevNodes[i] = p;
+				}
+				// The finger may pass through the node.
+				_fingerValid = false;
+				Detach(node, prevNodes);
+				return node;
+			}
 
-			Int32 GetNewLevel() const
+			// The first node from the node on that is not a tombstone, or _nil.
+			static PNode SkipTombstones(PNode node)
+			{
+				while (node != null && node->IsTombstone())
+				{
+					node = node->Next();
+				}
+				return node;
+			}
+
+			// After removing nodes, we may need to lower the current skip list level if they had the highest level of all of the nodes.
+			void ShrinkLevel()
 			{
-				var level = 1;
-				// Determines the next node level.
-				while (_random.NextDouble() < Probability
-					&& level < MaxLevel
-					&& level <= _listLevel)
+				while (_listLevel > 1 && _head->NeighborNodes[_listLevel - 1] == _nil)
 				{
-					level++;
+					--_listLevel;
 				}
-				return level;
 			}
 
-			PNode Find(TKey key) const
+			// The last node before the key, searching forward from start, which must precede the key.
+			PNode SeekBefore(PNode start, const TKey &key, UInt64 prefix) const
+			{
+				PNode prevNodes[MaxLevel];
+				FindPrevNodes(start, key, prefix, prevNodes);
+				return prevNodes[0];
+			}
+
+			// The last node of every level below the list level, found along the rightmost search path.
+			void LastNodes(PNode *lasts) const
 			{
 				var p = _head;
 				for (var i = _listLevel - 1; i >= 0; --i)
 				{
-					while (p->NeighborNodes[i] != _nil && _comparer.Less(p->NeighborNodes[i]->Item.first, key))
+					while (p->NeighborNodes[i] != _nil)
 					{
-						p = p->NeighborNodes[i]; // Move forward in the skip list.
+						p = p->NeighborNodes[i];
 					}
-					if (p->NeighborNodes[i] != _nil && _comparer.Equals(p->NeighborNodes[i]->Item.first, key)) return p->NeighborNodes[i];
+					lasts[i] = p;
 				}
-				return null;
 			}
 
-			PNode Insert(const pair<TKey, TValue> &item, vector<PNode> &prevNodes)
+			// Empties the list without destroying its nodes and returns the first of them; their level 0 links stay intact.
+			PNode TakeAll()
 			{
-				var newLevel = GetNewLevel(); // Get the level for the new node.
-				var newNode = new Node(newLevel, item);
+				var first = _head->Next();
+				Initialize();
+				return first;
+			}
 
-				for (var i = 0; i < _listLevel && i < newLevel; ++i)
+			// Links the node after the last one, keeping its height. While appending, the finger holds the last node of every level.
+			void Append(PNode node)
+			{
+				Link(node, _finger);
+				for (var i = 0; i < static_cast<Int32>(node->Height()); ++i)
 				{
-					// The new node next references are initialized to point to our update next references which point to nodes further along in the skip list.
-					newNode->NeighborNodes[i] = prevNodes[i]->NeighborNodes[i];
-					// Take our update next references and point them towards the new node. 
-					prevNodes[i]->NeighborNodes[i] = newNode;
+					_finger[i] = node;
 				}
-				if (newLevel > _listLevel)
+			}
+
+			// Appends a node of a chain taken by TakeAll and returns the next node of the chain.
+			PNode AppendNext(PNode node)
+			{
+				var next = node->Next();
+				Append(node);
+				return next;
+			}
+
+			void AppendAll(PNode node)
+			{
+				while (node != _nil)
 				{
-					// Make sure our update references above the current skip list level point to the header. 
-					for (var i = _listLevel; i < newLevel; ++i)
-					{
-						newNode->NeighborNodes[i] = _head->NeighborNodes[i];
-						_head->NeighborNodes[i] = newNode;
-					}
-					_listLevel = newLevel; // The current skip list level is now the new node level.
+					node = AppendNext(node);
 				}
-				++_count;
-				return newNode;
 			}
 
-			pair<vector<PNode>, bool> FindPrevNodes(TKey key) const
+			void FilterRemoved(SizeType count)
 			{
-				vector<PNode> prevNodes(_listLevel, null);
+				_filter.Removed(count);
+				if (_filter.NeedsRebuild()) RebuildFilter();
+			}
 
-				var p = _head;
-				var exist = false;
-				for (var i = _listLevel - 1; i >= 0; i--)
+			// Refills the filter from the keys in the list, sizing it for their count.
+			void RebuildFilter()
+			{
+				_filter.Reset(_count);
+				for (var p = SkipTombstones(_head->Next()); p != _nil; p = SkipTombstones(p->Next()))
 				{
-					while (p->NeighborNodes[i] != _nil && _comparer.Less(p->NeighborNodes[i]->Item.first, key))
-					{
-						p = p->NeighborNodes[i]; // Move forward in the skip list.
-					}
-					prevNodes[i] = p;
-					if (p->NeighborNodes[i] != _nil && _comparer.Equals(p->NeighborNodes[i]->Item.first, key)) exist = true;
+					_filter.Add(p->Item.first);
 				}
-				return{ prevNodes,exist };
 			}
 
 			void Initialize()
@@ -290,31 +2068,39 @@ namespace FclEx
 				{
 					_head->NeighborNodes[i] = _nil;
 				}
+				_head->Prev = _head;
 				_listLevel = 1;
 				_count = 0;
+				_tombstones = 0;
+				_filter.Clear();
+				_valueIndex.Clear();
+				for (var &node : _finger)
+				{
+					node = _head;
+				}
+				_fingerValid = true;
 			}
 
-			bool Remove(TKey key, bool checkValue, TValue value = default(TValue))
+			bool Remove(const TKey &key, bool checkValue, const TValue &value = default(TValue))
 			{
-				var prevNodesResult = FindPrevNodes(key);
-				if (!prevNodesResult.second) return false;
+				if (_compactRatio > 0)
+				{
+					// Only the search is paid; unlinking waits for Compact.
+					var node = FindNode(key);
+					if (node == null || (checkValue && !_valueComparer.Equals(node->Item.second, value))) return false;
+					node->SetTombstone();
+					--_count;
+					++_tombstones;
+					_valueIndex.Removed(node->Item.first, node->Item.second);
+					if (_tombstones > _compactRatio * (_count + _tombstones)) Compact();
+					return true;
+				}
+				if (!FindPrevNodes(key)) return false;
 
-				auto &prevNodes = prevNodesResult.first;
-				auto node = prevNodes[0]->Next;
+				auto node = _finger[0]->Next();
 				if (checkValue && !_valueComparer.Equals(node->Item.second, value)) return false;
 
-				for (SizeType i = 0; i < prevNodes.size(); i++)
-				{
-					if (prevNodes[i]->NeighborNodes[i] != node) break;
-					prevNodes[i]->NeighborNodes[i] = node->NeighborNodes[i];
-				}
-				delete node;
-				// After removing the node, we may need to lower the current skip list level if the node had the highest level of all of the nodes.
-				while (_listLevel > 1 && _head->NeighborNodes[_listLevel - 1] == _head)
-				{
-					--_listLevel;
-				}
-				--_count;
+				Unlink(node, _finger);
 				return true;
 			}
 
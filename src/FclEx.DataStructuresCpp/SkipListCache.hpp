@@ -0,0 +1,383 @@
+#pragma once
+
+#include "Define.h"
+#include "SkipList.hpp"
+#include <memory>
+#include "NonCopyable.hpp"
+
+namespace FclEx
+{
+	namespace Collections
+	{
+		using namespace std;
+
+		// The order in which a SkipListCache evicts: least recently used first, or CLOCK, which is first in first out
+		// except that an entry used since the hand last passed it gets a second chance. CLOCK only sets a bit on a hit.
+		enum class CacheEviction
+		{
+			Lru,
+			Clock
+		};
+
+		// The value of a SkipListCache node, with the links of the node in the eviction order and in its timer slot.
+		// The links are node pointers, so an evicted or expired node is erased from the list without a search.
+		template<typename TKey, typename TValue, typename Allocator, bool CachePrefix>
+		struct SkipListCacheEntry
+		{
+			using NodeAllocator = typename allocator_traits<Allocator>::template rebind_alloc<pair<TKey, SkipListCacheEntry>>;
+			using PNode = SkipListNode<TKey, SkipListCacheEntry, NodeAllocator, CachePrefix>*;
+
+			TValue Value;
+			SizeType Cost;
+			UInt64 Expiry;		// The tick the entry expires at, or 0
+			UInt32 TimerSlot;	// The index of its timer slot while Expiry is set
+			bool Referenced;	// Used since the CLOCK hand passed it
+			PNode Older;
+			PNode Newer;
+			PNode TimerPrev;
+			PNode TimerNext;
+
+			SkipListCacheEntry() : SkipListCacheEntry(TValue()) { }
+
+			explicit SkipListCacheEntry(const TValue &value) :
+				Value(value), Cost(0), Expiry(0), TimerSlot(0), Referenced(false),
+				Older(null), Newer(null), TimerPrev(null), TimerNext(null) { }
+
+			// Entries compare by value, for the members of the list that compare values.
+			bool operator<(const SkipListCacheEntry &other) const
+			{
+				return Value < other.Value;
+			}
+		};
+
+		// An ordered cache: a SkipList whose entries are evicted once their total cost exceeds a budget, in LRU or CLOCK order,
+		// and expire after a time to live. The cost of an entry is given on Put, 1 for an entry budget or a size in bytes
+		// for a memory budget. Expiry runs on a hierarchical timing wheel of 4 levels of 64 slots driven by Advance, so
+		// an entry is moved at most 3 times before it expires, and neither eviction nor expiry ever walks the list.
+		// Time is counted in ticks, whose length is up to the caller; entries further out than 64^4 ticks wait in the top level.
+		template<typename TKey,
+			typename TValue,
+			typename TLess = less<TKey>,
+			typename Allocator = allocator<pair<TKey, TValue>>>
+			class SkipListCache : NonCopyable
+		{
+		public:
+
+			using Entry = SkipListCacheEntry<TKey, TValue, Allocator, SkipListKeyPrefix<TKey, TLess>::Type::Enabled>;
+			using List = SkipList<TKey, Entry, TLess, typename Entry::NodeAllocator>;
+			using PNode = typename Entry::PNode;
+
+			explicit SkipListCache(SizeType budget, CacheEviction eviction = CacheEviction::Lru) :
+				_budget(budget),
+				_eviction(eviction),
+				_cost(0),
+				_now(0),
+				_scheduled(0),
+				_oldest(null),
+				_newest(null),
+				_hits(0),
+				_misses(0),
+				_evictions(0),
+				_expirations(0)
+			{
+				for (var &slot : _slots)
+				{
+					slot = null;
+				}
+				for (var &count : _levelCounts)
+				{
+					count = 0;
+				}
+			}
+
+			// Inserts or replaces the value of the key, then evicts until the total cost is within the budget.
+			// A ttl of 0 never expires; otherwise the entry expires ttl ticks from now.
+			void Put(const TKey &key, const TValue &value, SizeType cost = 1, UInt64 ttl = 0)
+			{
+				var result = _list.TryEmplace(key, value);
+				var node = result.first.GetNode();
+				var &entry = node->Item.second;
+				if (!result.second)
+				{
+					entry.Value = value;
+					_cost -= entry.Cost;
+					Unschedule(node);
+					Unqueue(node);
+				}
+				entry.Cost = cost;
+				entry.Referenced = false;
+				_cost += cost;
+				Enqueue(node);
+				if (ttl != 0)
+				{
+					entry.Expiry = _now + ttl;
+					Schedule(node);
+					++_scheduled;
+				}
+				while (_cost > _budget && _oldest != null)
+				{
+					Evict();
+				}
+			}
+
+			// Looks the key up, counting a hit or a miss; a hit counts as a use of the entry.
+			bool TryGetValue(const TKey &key, TValue &value)
+			{
+				var it = _list.Find(key);
+				if (it == _list.end())
+				{
+					++_misses;
+					return false;
+				}
+				++_hits;
+				var node = it.GetNode();
+				if (_eviction == CacheEviction::Lru)
+				{
+					Unqueue(node);
+					Enqueue(node);
+				}
+				else
+				{
+					node->Item.second.Referenced = true;
+				}
+				value = node->Item.second.Value;
+				return true;
+			}
+
+			bool ContainsKey(const TKey &key) const
+			{
+				return _list.ContainsKey(key);
+			}
+
+			bool Remove(const TKey &key)
+			{
+				var it = _list.Find(key);
+				if (it == _list.end()) return false;
+				Erase(it.GetNode());
+				return true;
+			}
+
+			// Moves the clock on by the ticks and drops the entries that expire meanwhile.
+			void Advance(UInt64 ticks)
+			{
+				if (_scheduled == 0)
+				{
+					_now += ticks;
+					return;
+				}
+				for (; ticks > 0 && _scheduled > 0; --ticks)
+				{
+					// Nothing fires before the next wrap of the lowest occupied level, so the ticks up to it pass at once.
+					var lowest = 0;
+					while (lowest < Levels - 1 && _levelCounts[lowest] == 0)
+					{
+						++lowest;
+					}
+					if (lowest > 0)
+					{
+						var span = UInt64(1) << (lowest * SlotBits);
+						var skip = span - (_now & (span - 1)) - 1;
+						if (skip >= ticks) break;
+						_now += skip;
+						ticks -= skip;
+					}
+					++_now;
+					// Each time a level wraps, the next slot of the level above is spread over the levels below.
+					for (var level = 1; level < Levels; ++level)
+					{
+						var shift = level * SlotBits;
+						if ((_now & ((UInt64(1) << shift) - 1)) != 0) break;
+						Cascade(level, static_cast<SizeType>(_now >> shift) & SlotMask);
+					}
+					var &slot = _slots[_now & SlotMask];
+					while (slot != null)
+					{
+						++_expirations;
+						Erase(slot);
+					}
+				}
+				// Nothing left to expire: the rest of the ticks pass at once.
+				_now += ticks;
+			}
+
+			void Clear()
+			{
+				_list.Clear();
+				for (var &slot : _slots)
+				{
+					slot = null;
+				}
+				_oldest = null;
+				_newest = null;
+				_cost = 0;
+				_scheduled = 0;
+				for (var &count : _levelCounts)
+				{
+					count = 0;
+				}
+			}
+
+			// The entries in key order.
+			const List &Items() const
+			{
+				return _list;
+			}
+
+			SizeType Count() const
+			{
+				return _list.Count();
+			}
+
+			SizeType Cost() const
+			{
+				return _cost;
+			}
+
+			SizeType Budget() const
+			{
+				return _budget;
+			}
+
+			UInt64 Now() const
+			{
+				return _now;
+			}
+
+			UInt64 Hits() const
+			{
+				return _hits;
+			}
+
+			UInt64 Misses() const
+			{
+				return _misses;
+			}
+
+			UInt64 Evictions() const
+			{
+				return _evictions;
+			}
+
+			UInt64 Expirations() const
+			{
+				return _expirations;
+			}
+
+		private:
+
+			static constexpr Int32 Levels = 4;				// Levels of the timing wheel
+			static constexpr Int32 SlotBits = 6;
+			static constexpr SizeType SlotMask = (1 << SlotBits) - 1;
+
+			const SizeType _budget;
+			const CacheEviction _eviction;
+			SizeType _cost;									// The total cost of the entries
+			UInt64 _now;									// The current tick
+			SizeType _scheduled;							// Entries with an expiry
+			SizeType _levelCounts[Levels];					// Entries in the slots of each level
+			List _list;
+			PNode _oldest;									// The ends of the eviction order, the CLOCK hand at _oldest
+			PNode _newest;
+			PNode _slots[Levels << SlotBits];				// The timer slots, level by level; each a list through TimerNext
+			UInt64 _hits;
+			UInt64 _misses;
+			UInt64 _evictions;
+			UInt64 _expirations;
+
+			void Evict()
+			{
+				var node = _oldest;
+				if (_eviction == CacheEviction::Clock)
+				{
+					// Give the entries used since the last pass another round; every bit cleared was set by a hit.
+					while (node->Item.second.Referenced)
+					{
+						node->Item.second.Referenced = false;
+						Unqueue(node);
+						Enqueue(node);
+						node = _oldest;
+					}
+				}
+				++_evictions;
+				Erase(node);
+			}
+
+			void Erase(PNode node)
+			{
+				Unschedule(node);
+				Unqueue(node);
+				_cost -= node->Item.second.Cost;
+				_list.erase(typename List::Iterator(node));
+			}
+
+			// Links the node as the newest in the eviction order.
+			void Enqueue(PNode node)
+			{
+				var &entry = node->Item.second;
+				entry.Older = _newest;
+				entry.Newer = null;
+				(_newest == null ? _oldest : _newest->Item.second.Newer) = node;
+				_newest = node;
+			}
+
+			void Unqueue(PNode node)
+			{
+				var &entry = node->Item.second;
+				(entry.Older == null ? _oldest : entry.Older->Item.second.Newer) = entry.Newer;
+				(entry.Newer == null ? _newest : entry.Newer->Item.second.Older) = entry.Older;
+			}
+
+			// Puts the node in the slot of the lowest level whose span reaches its expiry.
+			void Schedule(PNode node)
+			{
+				var expiry = node->Item.second.Expiry;
+				var delta = expiry > _now ? expiry - _now : 0;
+				var level = 0;
+				while (level < Levels - 1 && delta >> ((level + 1) * SlotBits) != 0)
+				{
+					++level;
+				}
+				var shift = level * SlotBits;
+				if (delta >> ((level + 1) * SlotBits) != 0)
+				{
+					// Beyond the top level's span: wait in its last slot and get scheduled again from there.
+					expiry = _now + (UInt64(SlotMask) << shift);
+				}
+				var index = (level << SlotBits) + (static_cast<SizeType>(expiry >> shift) & SlotMask);
+				var &slot = _slots[index];
+				var &entry = node->Item.second;
+				entry.TimerSlot = static_cast<UInt32>(index);
+				++_levelCounts[level];
+				entry.TimerPrev = null;
+				entry.TimerNext = slot;
+				if (slot != null) slot->Item.second.TimerPrev = node;
+				slot = node;
+			}
+
+			void Unschedule(PNode node)
+			{
+				var &entry = node->Item.second;
+				if (entry.Expiry == 0) return;
+				(entry.TimerPrev == null ? _slots[entry.TimerSlot] : entry.TimerPrev->Item.second.TimerNext) = entry.TimerNext;
+				if (entry.TimerNext != null) entry.TimerNext->Item.second.TimerPrev = entry.TimerPrev;
+				--_levelCounts[entry.TimerSlot >> SlotBits];
+				entry.Expiry = 0;
+				--_scheduled;
+			}
+
+			void Cascade(Int32 level, SizeType index)
+			{
+				var &slot = _slots[(level << SlotBits) + index];
+				var node = slot;
+				slot = null;
+				while (node != null)
+				{
+					var next = node->Item.second.TimerNext;
+					--_levelCounts[level];
+					Schedule(node);
+					node = next;
+				}
+			}
+		};
+	}
+}
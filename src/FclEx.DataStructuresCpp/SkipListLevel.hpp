@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Define.h"
+#include "Random.hpp"
+
+namespace FclEx
+{
+	namespace Collections
+	{
+		// The level of a new node in a skip list whose highest level is listLevel, shared by all the skip lists.
+		// Each level above the first is taken with the probability, up to one above listLevel so the list grows
+		// a level at a time, and never beyond maxLevel.
+		inline Int32 NewLevel(const Random &random, Int32 listLevel, UInt32 maxLevel = 32, double probability = 0.5)
+		{
+			var level = 1;
+			while (random.NextDouble() < probability
+				&& static_cast<UInt32>(level) < maxLevel
+				&& level <= listLevel)
+			{
+				level++;
+			}
+			return level;
+		}
+	}
+}
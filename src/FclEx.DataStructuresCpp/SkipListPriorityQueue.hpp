@@ -0,0 +1,365 @@
+#pragma once
+
+#include "Define.h"
+#include "Random.hpp"
+#include "SkipListLevel.hpp"
+#include "Comparer.hpp"
+#include "EpochManager.hpp"
+#include <atomic>
+#include <ctime>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include "NonCopyable.hpp"
+
+namespace FclEx
+{
+	namespace Collections
+	{
+		using namespace std;
+
+		// Node of a SkipListPriorityQueue, allocated with an inline tower of atomic links like ConcurrentSkipListNode.
+		// Only level 0 links are ever marked: the low bit set on a node's NeighborNodes[0] means its successor is deleted.
+		template<typename TPriority, typename TValue, typename Allocator>
+		class SkipListPriorityQueueNode
+		{
+		public:
+
+			using PNode = SkipListPriorityQueueNode*;
+			using ItemType = pair<TPriority, TValue>;
+
+			ItemType Item;
+			atomic<bool> Inserting;		// Set until every level of the node is linked.
+
+			template<typename ...Args>
+			static PNode Create(SizeType level, Args&&... args)
+			{
+				if (level <= 0) throw std::invalid_argument("level");
+				ByteAllocator allocator;
+				var memory = allocator.allocate(AllocationSize(level));
+				try
+				{
+					return ::new (static_cast<void*>(memory)) SkipListPriorityQueueNode(level, forward<Args>(args)...);
+				}
+				catch (...)
+				{
+					allocator.deallocate(memory, AllocationSize(level));
+					throw;
+				}
+			}
+
+			static void Destroy(PNode node) noexcept
+			{
+				var size = AllocationSize(node->_height);
+				node->~SkipListPriorityQueueNode();
+				ByteAllocator().deallocate(reinterpret_cast<char*>(node), size);
+			}
+
+			static void Destroy(void *node) noexcept
+			{
+				Destroy(static_cast<PNode>(node));
+			}
+
+			static PNode GetPointer(UIntPtr link)
+			{
+				return reinterpret_cast<PNode>(link & ~MarkFlag);
+			}
+
+			static bool IsMarked(UIntPtr link)
+			{
+				return (link & MarkFlag) != 0;
+			}
+
+			static UIntPtr MakeLink(PNode node, bool marked = false)
+			{
+				return reinterpret_cast<UIntPtr>(node) | (marked ? MarkFlag : 0);
+			}
+
+			SkipListPriorityQueueNode(const SkipListPriorityQueueNode &) = delete;
+			SkipListPriorityQueueNode& operator=(const SkipListPriorityQueueNode &) = delete;
+
+			PNode Next() const
+			{
+				return GetPointer(NeighborNodes[0].load(memory_order_acquire));
+			}
+
+			// Whether the successor of the node is deleted, which, as deletions form a prefix, means the node is deleted too.
+			bool IsSuccessorDeleted() const
+			{
+				return IsMarked(NeighborNodes[0].load(memory_order_acquire));
+			}
+
+			SizeType Height() const
+			{
+				return _height;
+			}
+
+			static constexpr UIntPtr MarkFlag = 1;
+
+		private:
+
+			using ByteAllocator = typename allocator_traits<Allocator>::template rebind_alloc<char>;
+
+			UInt32 _height;
+
+		public:
+
+			// Declared with one slot, but Create() allocates room for Height() slots.
+			atomic<UIntPtr> NeighborNodes[1];
+
+		private:
+
+			template<typename ...Args>
+			explicit SkipListPriorityQueueNode(SizeType level, Args&&... args) :
+				Item(forward<Args>(args)...),
+				Inserting(true),
+				_height(static_cast<UInt32>(level))
+			{
+				for (SizeType i = 0; i < level; ++i)
+				{
+					::new (static_cast<void*>(&NeighborNodes[i])) atomic<UIntPtr>(0);
+				}
+			}
+
+			~SkipListPriorityQueueNode() = default;
+
+			static constexpr SizeType AllocationSize(SizeType level)
+			{
+				return sizeof(SkipListPriorityQueueNode) + (level - 1) * sizeof(atomic<UIntPtr>);
+			}
+		};
+
+		// A lock-free priority queue on a skip list (Linden & Jonsson, "A Skiplist-Based Concurrent Priority Queue
+		// with Minimal Memory Contention"). PopMin deletes the first undeleted node by setting the mark bit of its
+		// predecessor's level 0 link, so the deleted nodes always form a prefix of the list and a pop costs one
+		// fetch_or past it. The prefix is only unlinked, with a single CAS on the head, once a pop has walked past
+		// DeletedPrefixBound deleted nodes; until then pops do not write to the same links as pushes.
+		// Push, PopMin and Count are safe to call concurrently. Equal priorities are allowed and popped in no particular order.
+		template<typename TPriority,
+			typename TValue,
+			typename TLess = less<TPriority>,
+			typename Allocator = allocator<pair<TPriority, TValue>>>
+			class SkipListPriorityQueue : NonCopyable
+		{
+		public:
+
+			using Node = SkipListPriorityQueueNode<TPriority, TValue, Allocator>;
+			using PNode = typename Node::PNode;
+			using ItemType = typename Node::ItemType;
+
+			SkipListPriorityQueue() :
+				_head(Node::Create(MaxLevel)),
+				_listLevel(1),
+				_count(0)
+			{
+				_head->Inserting.store(false, memory_order_relaxed);
+			}
+
+			~SkipListPriorityQueue() noexcept
+			{
+				// The unlinked prefix is owned by the epoch manager; the rest, deleted or not, is still linked.
+				var p = _head;
+				while (p != null)
+				{
+					var q = p;
+					p = q->Next();
+					Node::Destroy(q);
+				}
+			}
+
+			// The number of elements, which may be stale by the time it is returned.
+			SizeType Count() const
+			{
+				var count = _count.load(memory_order_relaxed);
+				return count < 0 ? 0 : static_cast<SizeType>(count);
+			}
+
+			void Push(const TPriority &priority, const TValue &value)
+			{
+				EpochManager::Guard guard(_epoch);
+				var newLevel = GetNewLevel();
+				var newNode = Node::Create(newLevel, priority, value);
+				var levels = SearchLevels(newLevel);
+				PNode prevNodes[MaxLevel];
+				PNode nextNodes[MaxLevel];
+
+				PNode deleted;
+				for (;;)
+				{
+					deleted = FindPrevNodes(priority, prevNodes, nextNodes, levels);
+					newNode->NeighborNodes[0].store(Node::MakeLink(nextNodes[0]), memory_order_relaxed);
+					// Fails when the predecessor got a new successor, or had its successor deleted.
+					var expected = Node::MakeLink(nextNodes[0]);
+					if (prevNodes[0]->NeighborNodes[0].compare_exchange_strong(expected, Node::MakeLink(newNode), memory_order_acq_rel)) break;
+				}
+				_count.fetch_add(1, memory_order_relaxed);
+				RaiseListLevel(newLevel);
+
+				for (var i = 1; i < newLevel;)
+				{
+					newNode->NeighborNodes[i].store(Node::MakeLink(nextNodes[i]), memory_order_release);
+					// Stop once the new node or its successor here has been popped: nothing links to a popped node from above.
+					if (newNode->IsSuccessorDeleted()
+						|| (nextNodes[i] != null && (nextNodes[i]->IsSuccessorDeleted() || nextNodes[i] == deleted)))
+					{
+						break;
+					}
+					var expected = Node::MakeLink(nextNodes[i]);
+					if (prevNodes[i]->NeighborNodes[i].compare_exchange_strong(expected, Node::MakeLink(newNode), memory_order_acq_rel))
+					{
+						++i;
+						continue;
+					}
+					deleted = FindPrevNodes(priority, prevNodes, nextNodes, levels);
+					if (nextNodes[0] != newNode) break; // Popped meanwhile.
+				}
+				// From now on a pop may unlink the node.
+				newNode->Inserting.store(false, memory_order_release);
+			}
+
+			void Push(const ItemType &item)
+			{
+				Push(item.first, item.second);
+			}
+
+			// Removes an element with the least priority into item; returns false if the queue is empty.
+			bool PopMin(ItemType &item)
+			{
+				EpochManager::Guard guard(_epoch);
+				var observedHead = _head->NeighborNodes[0].load(memory_order_acquire);
+				var p = _head;
+				PNode newHead = null;
+				UInt32 offset = 0;
+				UIntPtr link;
+				do
+				{
+					if (Node::GetPointer(p->NeighborNodes[0].load(memory_order_acquire)) == null) return false;
+					// A node still being linked must stay reachable, and so must everything after it.
+					if (newHead == null && p->Inserting.load(memory_order_acquire)) newHead = p;
+					// Marking the link deletes the successor, unless someone else's mark was there first.
+					link = p->NeighborNodes[0].fetch_or(Node::MarkFlag, memory_order_acq_rel);
+					++offset;
+					p = Node::GetPointer(link);
+				} while (Node::IsMarked(link));
+
+				item = p->Item;
+				_count.fetch_sub(1, memory_order_relaxed);
+				if (offset < DeletedPrefixBound) return true;
+
+				// Cut the deleted prefix off the head up to the node just popped, which stays as the marker of the new prefix.
+				if (newHead == null) newHead = p;
+				if (_head->NeighborNodes[0].compare_exchange_strong(observedHead, Node::MakeLink(newHead, true), memory_order_acq_rel))
+				{
+					Restructure();
+					for (var q = Node::GetPointer(observedHead); q != newHead;)
+					{
+						var next = q->Next();
+						guard.Retire(q, &Node::Destroy);
+						q = next;
+					}
+				}
+				return true;
+			}
+
+			bool Empty() const
+			{
+				EpochManager::Guard guard(_epoch);
+				for (var p = _head; ; )
+				{
+					var link = p->NeighborNodes[0].load(memory_order_acquire);
+					if (Node::GetPointer(link) == null) return true;
+					if (!Node::IsMarked(link)) return false;
+					p = Node::GetPointer(link);
+				}
+			}
+
+		private:
+
+			static constexpr UInt32 MaxLevel = 32;				// Maximum level any node in a skip list can have
+			static constexpr double Probability = 0.5;			// Probability factor used to determine the node level
+			static constexpr UInt32 DeletedPrefixBound = 32;	// Deleted nodes a pop walks past before it unlinks the prefix
+			const PNode _head;									// The skip list header.
+
+			atomic<Int32> _listLevel;							// Highest level any node has reached; never lowered.
+			atomic<Int64> _count;								// Pushes minus pops; briefly negative while a push is linking.
+			const Comparer<TPriority, TLess> _comparer;
+			mutable EpochManager _epoch;
+
+			static const Random& ThreadRandom()
+			{
+				static thread_local const Random random(static_cast<uint>(hash<thread::id>()(this_thread::get_id()) ^ time(nullptr)));
+				return random;
+			}
+
+			Int32 GetNewLevel() const
+			{
+				return NewLevel(ThreadRandom(), _listLevel.load(memory_order_relaxed), MaxLevel, Probability);
+			}
+
+			// Fills prevNodes/nextNodes around the position of the priority for the lowest `levels` levels,
+			// skipping every deleted node, and returns the last deleted node met at level 0.
+			PNode FindPrevNodes(const TPriority &priority, PNode *prevNodes, PNode *nextNodes, Int32 levels) const
+			{
+				PNode deleted = null;
+				var p = _head;
+				for (var i = levels - 1; i >= 0; --i)
+				{
+					var link = p->NeighborNodes[i].load(memory_order_acquire);
+					var next = Node::GetPointer(link);
+					// At level 0 a marked link means next is deleted; at any level a node whose successor is deleted is.
+					while (next != null
+						&& (_comparer.Less(next->Item.first, priority) || next->IsSuccessorDeleted() || (i == 0 && Node::IsMarked(link))))
+					{
+						if (i == 0 && Node::IsMarked(link)) deleted = next;
+						p = next; // Move forward in the skip list.
+						link = p->NeighborNodes[i].load(memory_order_acquire);
+						next = Node::GetPointer(link);
+					}
+					prevNodes[i] = p;
+					nextNodes[i] = next;
+				}
+				return deleted;
+			}
+
+			// Moves the upper links of the head past the nodes of the deleted prefix, before they are retired.
+			void Restructure()
+			{
+				var p = _head;
+				for (var i = _listLevel.load(memory_order_acquire) - 1; i > 0;)
+				{
+					var first = Node::GetPointer(_head->NeighborNodes[i].load(memory_order_acquire));
+					if (first == null || !first->IsSuccessorDeleted())
+					{
+						--i;
+						continue;
+					}
+					var next = Node::GetPointer(p->NeighborNodes[i].load(memory_order_acquire));
+					while (next != null && next->IsSuccessorDeleted())
+					{
+						p = next;
+						next = Node::GetPointer(p->NeighborNodes[i].load(memory_order_acquire));
+					}
+					var expected = Node::MakeLink(first);
+					if (_head->NeighborNodes[i].compare_exchange_strong(expected, p->NeighborNodes[i].load(memory_order_acquire), memory_order_acq_rel))
+					{
+						--i;
+					}
+				}
+			}
+
+			// A node taller than the current list level may be linked at levels a search from _listLevel would miss.
+			Int32 SearchLevels(Int32 nodeLevel) const
+			{
+				var listLevel = _listLevel.load(memory_order_acquire);
+				return listLevel > nodeLevel ? listLevel : nodeLevel;
+			}
+
+			void RaiseListLevel(Int32 level)
+			{
+				var current = _listLevel.load(memory_order_relaxed);
+				while (current < level && !_listLevel.compare_exchange_weak(current, level, memory_order_acq_rel)) { }
+			}
+		};
+	}
+}
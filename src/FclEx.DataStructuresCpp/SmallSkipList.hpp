@@ -0,0 +1,369 @@
+#pragma once
+
+#include "Define.h"
+#include "IKeyValueCollection.h"
+#include "Comparer.hpp"
+#include "SkipList.hpp"
+#include "UnrolledSkipList.hpp"
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include "NonCopyable.hpp"
+
+namespace FclEx
+{
+	namespace Collections
+	{
+		using namespace std;
+
+		// Iterates a SmallSkipList, either over its inline arrays or over its SkipList.
+		// As in UnrolledSkipListIterator, an element is a pair of references since the inline keys and values are stored apart.
+		template<typename TKey, typename TValue, typename TListIterator>
+		class SmallSkipListIterator
+		{
+		public:
+			typedef forward_iterator_tag			iterator_category;
+			typedef pair<TKey, TValue>				value_type;
+			typedef ptrdiff_t						difference_type;
+			typedef pair<const TKey&, TValue&>		reference;
+
+			// Lets it->second work on the pair of references.
+			class pointer
+			{
+			public:
+				explicit pointer(reference item) : _item(item) { }
+
+				reference *operator->()
+				{
+					return &_item;
+				}
+
+			private:
+				reference _item;
+			};
+
+			SmallSkipListIterator(const TKey *keys, TValue *values, SizeType index) :
+				_keys(keys), _values(values), _index(index), _listIterator(null) { }
+
+			explicit SmallSkipListIterator(TListIterator listIterator) :
+				_keys(null), _values(null), _index(0), _listIterator(listIterator) { }
+
+			const TKey &Key() const
+			{
+				return _keys != null ? _keys[_index] : _listIterator.GetNode()->Item.first;
+			}
+
+			TValue &Value() const
+			{
+				return _keys != null ? _values[_index] : _listIterator.GetNode()->Item.second;
+			}
+
+			reference operator*() const
+			{
+				return reference(Key(), Value());
+			}
+
+			pointer operator->() const
+			{
+				return pointer(operator*());
+			}
+
+			SmallSkipListIterator &operator++()
+			{
+				if (_keys != null) ++_index;
+				else ++_listIterator;
+				return *this;
+			}
+
+			SmallSkipListIterator operator++(int)
+			{
+				SmallSkipListIterator old(*this);
+				operator++();
+				return old;
+			}
+
+			bool operator==(const SmallSkipListIterator &other) const
+			{
+				return _keys == other._keys && _index == other._index && _listIterator == other._listIterator;
+			}
+
+			bool operator!=(const SmallSkipListIterator &other) const
+			{
+				return !operator==(other);
+			}
+
+		private:
+			const TKey *_keys;
+			TValue *_values;
+			SizeType _index;
+			TListIterator _listIterator;
+		};
+
+		// A map for the many collections that stay tiny. Up to Threshold elements are kept sorted in inline arrays,
+		// searched like the keys of an UnrolledSkipList node, with no allocation at all; one more promotes it to a SkipList.
+		// It demotes back to the arrays once a removal leaves half the threshold, so sizes around the threshold do not thrash.
+		template<typename TKey,
+			typename TValue,
+			typename TLess = less<TKey>,
+			typename Allocator = allocator<pair<TKey, TValue>>,
+			SizeType Threshold = 16>
+			class SmallSkipList : IKeyValueCollection<TKey, TValue>, NonCopyable
+		{
+			static_assert(Threshold > 1, "The threshold must be greater than one.");
+
+		public:
+
+			using List = SkipList<TKey, TValue, TLess, Allocator>;
+			using ItemType = pair<TKey, TValue>;
+			using Iterator = SmallSkipListIterator<TKey, TValue, typename List::Iterator>;
+
+			SmallSkipList() : _size(0) { }
+
+			~SmallSkipList() noexcept
+			{
+				DestroyFlat();
+			}
+
+			// Whether the elements are in the inline arrays rather than in a SkipList.
+			bool IsFlat() const
+			{
+				return _list == null;
+			}
+
+			SizeType Count() const override
+			{
+				return _list == null ? _size : _list->Count();
+			}
+
+			Iterator begin() const
+			{
+				return _list == null ? Iterator(Keys(), Values(), 0) : Iterator(_list->begin());
+			}
+
+			Iterator end() const
+			{
+				return _list == null ? Iterator(Keys(), Values(), _size) : Iterator(_list->end());
+			}
+
+			// The element with the key, or end().
+			Iterator Find(const TKey &key) const
+			{
+				if (_list != null) return Iterator(_list->Find(key));
+				return Iterator(Keys(), Values(), FindIndex(key));
+			}
+
+			void Add(const ItemType &item) override
+			{
+				Insert(item.first, item.second);
+			}
+
+			void Add(const TKey& key, const TValue& value) override
+			{
+				Insert(key, value);
+			}
+
+			void Clear() override
+			{
+				DestroyFlat();
+				_list.reset();
+			}
+
+			bool Contains(const ItemType &item) const override
+			{
+				if (_list != null) return _list->Contains(item);
+				var index = FindIndex(item.first);
+				return index < _size && _valueComparer.Equals(Values()[index], item.second);
+			}
+
+			bool Remove(const ItemType &item) override
+			{
+				if (_list != null) return RemoveFromList(_list->Remove(item));
+				var index = FindIndex(item.first);
+				if (index == _size || !_valueComparer.Equals(Values()[index], item.second)) return false;
+				RemoveAt(index);
+				return true;
+			}
+
+			//// index-get
+			const TValue& operator[](const TKey& key) const override
+			{
+				static const TValue defaultValue = default(TValue);
+				if (_list != null) return static_cast<const List&>(*_list)[key];
+				var index = FindIndex(key);
+				return index == _size ? defaultValue : Values()[index];
+			}
+
+			//// index-set
+			TValue& operator[](const TKey& key) override
+			{
+				return Insert(key);
+			}
+
+			bool ContainsKey(const TKey& key) const override
+			{
+				if (_list != null) return _list->ContainsKey(key);
+				return FindIndex(key) < _size;
+			}
+
+			bool ContainsValue(const TValue& value) const override
+			{
+				for (const auto &item : *this)
+				{
+					if (_valueComparer.Equals(item.second, value)) return true;
+				}
+				return false;
+			}
+
+			bool Remove(const TKey& key) override
+			{
+				if (_list != null) return RemoveFromList(_list->Remove(key));
+				var index = FindIndex(key);
+				if (index == _size) return false;
+				RemoveAt(index);
+				return true;
+			}
+
+		private:
+
+			static constexpr SizeType DemoteCount = Threshold / 2;	// A SkipList this small moves back into the arrays
+
+			UInt32 _size;											// Elements in the arrays; 0 while promoted
+			typename aligned_storage<sizeof(TKey) * Threshold, alignof(TKey)>::type _keys;
+			typename aligned_storage<sizeof(TValue) * Threshold, alignof(TValue)>::type _values;
+			unique_ptr<List> _list;									// The elements once promoted, otherwise null.
+			const Comparer<TKey, TLess> _comparer;
+			const Comparer<TValue> _valueComparer;
+
+			TKey *Keys() const
+			{
+				return reinterpret_cast<TKey*>(&const_cast<SmallSkipList*>(this)->_keys);
+			}
+
+			TValue *Values() const
+			{
+				return reinterpret_cast<TValue*>(&const_cast<SmallSkipList*>(this)->_values);
+			}
+
+			// The index of the key in the arrays, or _size.
+			SizeType FindIndex(const TKey &key) const
+			{
+				var index = UnrolledKeySearch<TKey, TLess>::CountLess(Keys(), _size, key, _comparer);
+				return index < _size && !_comparer.Less(key, Keys()[index]) ? index : _size;
+			}
+
+			// The value of the key, inserting one constructed from the arguments if the key is missing.
+			template<typename ...Args>
+			TValue &Insert(const TKey &key, Args&&... args)
+			{
+				if (_list == null)
+				{
+					var keys = Keys();
+					var values = Values();
+					var index = UnrolledKeySearch<TKey, TLess>::CountLess(keys, _size, key, _comparer);
+					if (index < _size && !_comparer.Less(key, keys[index])) return values[index];
+					if (_size < Threshold)
+					{
+						InsertAt(index, key, forward<Args>(args)...);
+						return values[index];
+					}
+					Promote();
+				}
+				return _list->TryEmplace(key, forward<Args>(args)...).first.GetNode()->Item.second;
+			}
+
+			template<typename ...Args>
+			void InsertAt(SizeType index, const TKey &key, Args&&... args)
+			{
+				var keys = Keys();
+				var values = Values();
+				if (index == _size)
+				{
+					::new (static_cast<void*>(keys + index)) TKey(key);
+					::new (static_cast<void*>(values + index)) TValue(forward<Args>(args)...);
+				}
+				else
+				{
+					// The last element moves into the free slot, the rest shift up by one.
+					::new (static_cast<void*>(keys + _size)) TKey(move(keys[_size - 1]));
+					::new (static_cast<void*>(values + _size)) TValue(move(values[_size - 1]));
+					move_backward(keys + index, keys + _size - 1, keys + _size);
+					move_backward(values + index, values + _size - 1, values + _size);
+					keys[index] = key;
+					values[index] = TValue(forward<Args>(args)...);
+				}
+				++_size;
+			}
+
+			void RemoveAt(SizeType index)
+			{
+				var keys = Keys();
+				var values = Values();
+				move(keys + index + 1, keys + _size, keys + index);
+				move(values + index + 1, values + _size, values + index);
+				--_size;
+				keys[_size].~TKey();
+				values[_size].~TValue();
+			}
+
+			bool RemoveFromList(bool removed)
+			{
+				if (removed && _list->Count() <= DemoteCount) Demote();
+				return removed;
+			}
+
+			// Moves the elements of the arrays into a new SkipList; on failure they are moved back.
+			void Promote()
+			{
+				unique_ptr<List> list(new List());
+				var keys = Keys();
+				var values = Values();
+				try
+				{
+					for (SizeType i = 0; i < _size; ++i)
+					{
+						list->TryEmplace(move(keys[i]), move(values[i]));
+					}
+				}
+				catch (...)
+				{
+					SizeType i = 0;
+					for (var &item : *list)
+					{
+						keys[i] = move(item.first);
+						values[i++] = move(item.second);
+					}
+					throw;
+				}
+				DestroyFlat();
+				_list = move(list);
+			}
+
+			void Demote()
+			{
+				var keys = Keys();
+				var values = Values();
+				for (var &item : *_list)
+				{
+					::new (static_cast<void*>(keys + _size)) TKey(move(item.first));
+					::new (static_cast<void*>(values + _size)) TValue(move(item.second));
+					++_size;
+				}
+				_list.reset();
+			}
+
+			void DestroyFlat()
+			{
+				var keys = Keys();
+				var values = Values();
+				for (SizeType i = 0; i < _size; ++i)
+				{
+					keys[i].~TKey();
+					values[i].~TValue();
+				}
+				_size = 0;
+			}
+		};
+	}
+}
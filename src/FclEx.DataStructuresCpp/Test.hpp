@@ -1,16 +1,29 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <ctime>
 #include <functional>
 #include <vector>
 #include <chrono>
+#include <list>
 #include <map>
+#include <mutex>
+#include <queue>
+#include <thread>
 
 #include "Define.h"
 #include "IKeyValueCollection.h"
+#include "Random.hpp"
 
 #ifndef SYSOUT_F
+#ifdef _MSC_VER
+#include <crtdbg.h>
 #define SYSOUT_F(f, ...) _RPT1( 0, f, __VA_ARGS__ ) // For Visual studio
+#else
+#include <cstdio>
+#define SYSOUT_F(f, ...) printf(f "\n", __VA_ARGS__)
+#endif
 #endif
 
 #ifndef SpeedTest__             
@@ -37,6 +50,41 @@ namespace FclEx
 		}
 	};
 
+	// A std::priority_queue behind a mutex, the baseline the concurrent priority queues are measured against.
+	template<typename TPriority, typename TValue>
+	class LockedPriorityQueue
+	{
+	public:
+		using ItemType = pair<TPriority, TValue>;
+
+		void Push(const TPriority &priority, const TValue &value)
+		{
+			lock_guard<mutex> lock(_mutex);
+			_heap.emplace(priority, value);
+		}
+
+		bool PopMin(ItemType &item)
+		{
+			lock_guard<mutex> lock(_mutex);
+			if (_heap.empty()) return false;
+			item = _heap.top();
+			_heap.pop();
+			return true;
+		}
+
+	private:
+		struct Greater
+		{
+			bool operator()(const ItemType &x, const ItemType &y) const
+			{
+				return y.first < x.first;
+			}
+		};
+
+		mutex _mutex;
+		priority_queue<ItemType, vector<ItemType>, Greater> _heap;
+	};
+
 	template<typename T, class TDic>
 	class TestDic
 	{
@@ -149,6 +197,731 @@ namespace FclEx
 			return result;
 		}
 
+		// Looks every key up once with ContainsKey, and once with ContainsKeyMany in batches of batchSize keys.
+		template<typename T, class TDic>
+		static map<string, Int64> TestBatchLookup(const TDic &dic, const vector<T> &keys, SizeType batchSize)
+		{
+			map<string, Int64> result;
+			SizeType found = 0;
+			result[nameof(ContainsKey)] = Measure<>::Execution([&dic, &keys, &found]()
+			{
+				for (auto &key : keys)
+				{
+					if (dic.ContainsKey(key)) ++found;
+				}
+			});
+			result[nameof(ContainsKeyMany)] = Measure<>::Execution([&dic, &keys, &found, batchSize]()
+			{
+				vector<T> batch;
+				vector<bool> contains;
+				for (SizeType i = 0; i < keys.size(); i += batchSize)
+				{
+					batch.assign(keys.begin() + i, keys.begin() + min(i + batchSize, keys.size()));
+					dic.ContainsKeyMany(batch, contains);
+					for (auto value : contains)
+					{
+						if (value) ++found;
+					}
+				}
+			});
+			return result;
+		}
+
+		// Adds the items, looks every item up once, and sums the values of all elements scans times.
+		template<typename T, class TDic>
+		static map<string, Int64> TestScan(TDic &dic, const vector<T> &items, SizeType scans)
+		{
+			map<string, Int64> result;
+			Int64 sum = 0;
+			result[nameof(Add)] = Measure<>::Execution(TestDic<T, TDic>::Add, dic, items);
+			result[nameof(ContainsKey)] = Measure<>::Execution(TestDic<T, TDic>::ContainsKey, dic, items);
+			result[nameof(Scan)] = Measure<>::Execution([&dic, &sum, scans]()
+			{
+				for (SizeType i = 0; i < scans; ++i)
+				{
+					for (auto item : dic)
+					{
+						sum += item.second;
+					}
+				}
+			});
+			return result;
+		}
+
+		// Runs the same mixed workload (Add, ContainsKey, IndexSet, Remove) on 1 to maxThreads threads,
+		// each thread working on its own slice of items, and records the elapsed milliseconds per thread count.
+		template<typename T, class TDic>
+		static map<UInt32, Int64> TestConcurrentKeyValueCollection(const vector<T> &items, UInt32 maxThreads)
+		{
+			map<UInt32, Int64> result;
+			for (UInt32 threadsNum = 1; threadsNum <= maxThreads; ++threadsNum)
+			{
+				TDic dic;
+				result[threadsNum] = Measure<>::Execution([&dic, &items, threadsNum]()
+				{
+					vector<thread> threads;
+					for (UInt32 i = 0; i < threadsNum; ++i)
+					{
+						threads.emplace_back([&dic, &items, threadsNum, i]()
+						{
+							vector<T> slice;
+							for (SizeType j = i; j < items.size(); j += threadsNum)
+							{
+								slice.push_back(items[j]);
+							}
+							TestDic<T, TDic>::Add(dic, slice);
+							TestDic<T, TDic>::ContainsKey(dic, slice);
+							TestDic<T, TDic>::IndexSet(dic, slice);
+							TestDic<T, TDic>::Remove(dic, slice);
+						});
+					}
+					for (var &t : threads)
+					{
+						t.join();
+					}
+				});
+			}
+			return result;
+		}
+
+		// Runs a scheduler-like workload on 1 to maxThreads threads: each thread pushes its slice of items
+		// as priorities, popping the minimum after every push past the first tenth, then drains the queue.
+		template<typename T, class TQueue>
+		static map<UInt32, Int64> TestConcurrentPriorityQueue(const vector<T> &items, UInt32 maxThreads)
+		{
+			map<UInt32, Int64> result;
+			for (UInt32 threadsNum = 1; threadsNum <= maxThreads; ++threadsNum)
+			{
+				TQueue queue;
+				result[threadsNum] = Measure<>::Execution([&queue, &items, threadsNum]()
+				{
+					vector<thread> threads;
+					for (UInt32 i = 0; i < threadsNum; ++i)
+					{
+						threads.emplace_back([&queue, &items, threadsNum, i]()
+						{
+							typename TQueue::ItemType item;
+							SizeType pushed = 0;
+							for (SizeType j = i; j < items.size(); j += threadsNum)
+							{
+								queue.Push(items[j], items[j]);
+								if (++pushed * 10 > items.size() / threadsNum) queue.PopMin(item);
+							}
+							while (queue.PopMin(item)) { }
+						});
+					}
+					for (var &t : threads)
+					{
+						t.join();
+					}
+				});
+			}
+			return result;
+		}
+
+		// Applies the same random Add, IndexSet and Remove operations to the map and to a std::map, over keys in [0, keyRange).
+		// After each operation it compares ContainsKey, IndexGet and Count, and every keyRange operations the elements in order.
+		// Returns the number of mismatches.
+		template<class TDic>
+		static SizeType VerifyKeyValueCollection(TDic &dic, SizeType operations, int keyRange, uint seed = 1)
+		{
+			map<int, int> expected;
+			Random random(seed);
+			SizeType mismatches = 0;
+			for (SizeType i = 0; i < operations; ++i)
+			{
+				var key = random.Next(0, keyRange - 1);
+				var value = random.Next();
+				switch (random.Next(0, 3))
+				{
+				case 0:
+					if (expected.count(key) == 0)
+					{
+						dic.Add(key, value);
+						expected[key] = value;
+					}
+					break;
+				case 1:
+					dic[key] = value;
+					expected[key] = value;
+					break;
+				default:
+					if (dic.Remove(key) != (expected.erase(key) != 0)) ++mismatches;
+					break;
+				}
+				const TDic &constDic = dic;
+				var found = expected.find(key);
+				if (dic.ContainsKey(key) != (found != expected.end())) ++mismatches;
+				if (found != expected.end() && constDic[key] != found->second) ++mismatches;
+				if (dic.Count() != expected.size()) ++mismatches;
+				if ((i + 1) % keyRange == 0 && !SameElements(dic, expected)) ++mismatches;
+			}
+			if (!SameElements(dic, expected)) ++mismatches;
+			dic.Clear();
+			if (dic.Count() != 0 || dic.begin() != dic.end()) ++mismatches;
+			return mismatches;
+		}
+
+		// Each round opens the list stored in the file, compares it with a std::map, applies random IndexSet and Remove
+		// operations over keys in [0, keyRange), flushes and closes it. Then it clears the list and checks that it reopens
+		// empty. The file must not exist beforehand. Returns the number of mismatches.
+		template<class TList>
+		static SizeType VerifyReopen(const char *filename, SizeType rounds, SizeType operations, int keyRange, uint seed = 1)
+		{
+			map<int, int> expected;
+			Random random(seed);
+			SizeType mismatches = 0;
+			var check = [&mismatches, &expected, keyRange](const TList &list)
+			{
+				if (list.Count() != expected.size() || !SameElements(list, expected)) ++mismatches;
+				for (var key = 0; key < keyRange; ++key)
+				{
+					var found = expected.find(key);
+					if (list.ContainsKey(key) != (found != expected.end())) ++mismatches;
+					else if (found != expected.end() && list[key] != found->second) ++mismatches;
+				}
+			};
+
+			for (SizeType round = 0; round < rounds; ++round)
+			{
+				TList list(filename);
+				check(list);
+				for (SizeType i = 0; i < operations; ++i)
+				{
+					var key = random.Next(0, keyRange - 1);
+					if (random.Next(0, 2) != 0)
+					{
+						var value = random.Next();
+						list[key] = value;
+						expected[key] = value;
+					}
+					else if (list.Remove(key) != (expected.erase(key) != 0)) ++mismatches;
+				}
+				list.Flush();
+			}
+			{
+				TList list(filename);
+				check(list);
+				list.Clear();
+				list.Flush();
+			}
+			expected.clear();
+			TList list(filename);
+			check(list);
+			return mismatches;
+		}
+
+		// Applies random Put and Remove operations over keys in [0, keyRange) to a store in the directory, which must exist
+		// and be empty, and to a std::map; the small memtable limit makes the store flush several runs and compact them in
+		// the background. The store is then reopened, compared, compacted and compared again, comparing TryGetValue,
+		// ContainsKey and the items in order each time. Returns the number of mismatches.
+		template<class TStore>
+		static SizeType VerifyLsmStore(const string &directory, SizeType operations, int keyRange, SizeType memtableLimit, uint seed = 1)
+		{
+			map<int, int> expected;
+			Random random(seed);
+			SizeType mismatches = 0;
+			var check = [&mismatches, &expected, keyRange](const TStore &store)
+			{
+				if (!SameElements(store, expected)) ++mismatches;
+				for (var key = 0; key < keyRange; ++key)
+				{
+					int value;
+					var found = expected.find(key);
+					if (store.ContainsKey(key) != (found != expected.end())) ++mismatches;
+					if (store.TryGetValue(key, value) != (found != expected.end())) ++mismatches;
+					else if (found != expected.end() && value != found->second) ++mismatches;
+				}
+			};
+
+			{
+				TStore store(directory, memtableLimit);
+				for (SizeType i = 0; i < operations; ++i)
+				{
+					var key = random.Next(0, keyRange - 1);
+					if (random.Next(0, 2) != 0)
+					{
+						var value = random.Next();
+						store.Put(key, value);
+						expected[key] = value;
+					}
+					else
+					{
+						store.Remove(key);
+						expected.erase(key);
+					}
+					if ((i + 1) % memtableLimit == 0) check(store);
+				}
+				if (store.RunsCount() == 0) ++mismatches;
+				check(store);
+			}
+
+			TStore store(directory, memtableLimit);
+			check(store);
+			store.Compact();
+			if (store.RunsCount() != 1) ++mismatches;
+			check(store);
+			return mismatches;
+		}
+
+		// Fills a SkipList with count random keys and checks that Clone keeps the elements in order with every tower at
+		// its height and finds each key, also through a copied filter, that moves by construction, by assignment and by a growing vector carry the elements over, and
+		// that the moved-from lists are left empty and work again. Returns the number of mismatches.
+		template<class TList>
+		static SizeType VerifyCloneAndMove(SizeType count, uint seed = 1)
+		{
+			map<int, int> expected;
+			Random random(seed);
+			TList list;
+			for (SizeType i = 0; i < count; ++i)
+			{
+				var key = random.Next();
+				list[key] = key / 2;
+				expected[key] = key / 2;
+			}
+			SizeType mismatches = 0;
+
+			var clone = list.Clone();
+			var it = list.begin();
+			for (var cloneIt = clone.begin(); cloneIt != clone.end(); ++cloneIt, ++it)
+			{
+				if (it == list.end() || cloneIt->first != it->first || cloneIt->second != it->second
+					|| cloneIt.GetNode()->Height() != it.GetNode()->Height()) ++mismatches;
+			}
+			if (it != list.end() || clone.Count() != list.Count()) ++mismatches;
+			for (const var &item : expected)
+			{
+				if (!clone.ContainsKey(item.first)) ++mismatches;
+			}
+
+			TList moved(move(clone));
+			TList assigned;
+			assigned[0] = 0;
+			assigned = move(moved);
+			if (!SameElements(assigned, expected)) ++mismatches;
+			for (var emptied : { &clone, &moved })
+			{
+				if (emptied->Count() != 0 || emptied->begin() != emptied->end()) ++mismatches;
+				mismatches += VerifyKeyValueCollection(*emptied, 10 * 1000, 100, seed);
+			}
+
+			vector<TList> lists;
+			for (var i = 0; i < 8; ++i)
+			{
+				lists.push_back(list.Clone());
+			}
+			for (var &item : lists)
+			{
+				if (!SameElements(item, expected)) ++mismatches;
+				for (const var &entry : expected)
+				{
+					if (!item.ContainsKey(entry.first)) ++mismatches;
+				}
+			}
+			return mismatches;
+		}
+
+		// Each round takes a snapshot of the concurrent list and lets threads Add and Remove random keys in [0, keyRange)
+		// while this thread keeps comparing the snapshot's iteration and ContainsKey with the contents before it was taken,
+		// once more after the writers are done. The contents for the next round are read back through TryGetValue.
+		// Returns the number of mismatches.
+		template<class TList>
+		static SizeType VerifySnapshot(UInt32 threadsNum, SizeType rounds, SizeType operations, int keyRange, uint seed = 1)
+		{
+			TList list;
+			map<int, int> expected;
+			for (var key = 0; key < keyRange; key += 2)
+			{
+				list.Add(key, key);
+				expected[key] = key;
+			}
+			SizeType mismatches = 0;
+			var check = [&mismatches, &expected, keyRange](const typename TList::Snapshot &snapshot)
+			{
+				if (!SameElements(snapshot, expected)) ++mismatches;
+				for (var key = 0; key < keyRange; ++key)
+				{
+					if (snapshot.ContainsKey(key) != (expected.count(key) != 0)) ++mismatches;
+				}
+			};
+
+			for (SizeType round = 0; round < rounds; ++round)
+			{
+				var snapshot = list.TakeSnapshot();
+				atomic<UInt32> running(threadsNum);
+				vector<thread> threads;
+				for (UInt32 i = 0; i < threadsNum; ++i)
+				{
+					threads.emplace_back([&list, &running, operations, keyRange, round, i, seed]()
+					{
+						Random random(static_cast<uint>(seed + round * 131 + i));
+						for (SizeType j = 0; j < operations; ++j)
+						{
+							var key = random.Next(0, keyRange - 1);
+							if (random.Next(0, 1) == 0) list.Add(key, -key - 1);
+							else list.Remove(key);
+						}
+						running.fetch_sub(1);
+					});
+				}
+				do
+				{
+					check(snapshot);
+				} while (running.load() != 0);
+				for (var &t : threads)
+				{
+					t.join();
+				}
+				check(snapshot);
+
+				expected.clear();
+				for (var key = 0; key < keyRange; ++key)
+				{
+					int value;
+					if (list.TryGetValue(key, value)) expected[key] = value;
+				}
+			}
+			return mismatches;
+		}
+
+		// Each round changes a SkipList with random IndexSet and Remove operations, splits it at a random key, removes a key
+		// from each half and joins them back in a random order, comparing both halves and the joined list with a std::map.
+		// Every other round removes lazily, so Split and Join meet tombstones. Afterwards it joins an empty list both ways,
+		// and checks that joining overlapping lists either way throws invalid_argument and leaves both lists as they were.
+		// Returns the number of mismatches.
+		template<class TList>
+		static SizeType VerifySplitAndJoin(SizeType rounds, int keyRange, uint seed = 1)
+		{
+			map<int, int> expected;
+			Random random(seed);
+			TList list;
+			SizeType mismatches = 0;
+			var removeAny = [&random, keyRange](TList &from, map<int, int> &model)
+			{
+				var key = random.Next(0, keyRange - 1);
+				from.Remove(key);
+				model.erase(key);
+			};
+
+			for (SizeType round = 0; round < rounds; ++round)
+			{
+				// A ratio of 1 leaves every tombstone for Split and Join to compact.
+				if (round % 2 == 0) list.DisableLazyRemoval();
+				else list.EnableLazyRemoval(1);
+				for (var i = 0; i < 50; ++i)
+				{
+					var key = random.Next(0, keyRange - 1);
+					if (random.Next(0, 2) != 0)
+					{
+						list[key] = key;
+						expected[key] = key;
+					}
+					else removeAny(list, expected);
+				}
+
+				var key = random.Next(0, keyRange);
+				TList upper;
+				list.Split(key, upper);
+				map<int, int> lower(expected.begin(), expected.lower_bound(key));
+				map<int, int> higher(expected.lower_bound(key), expected.end());
+				if (!SameElements(list, lower) || list.Count() != lower.size()) ++mismatches;
+				if (!SameElements(upper, higher) || upper.Count() != higher.size()) ++mismatches;
+				removeAny(list, lower);
+				removeAny(upper, higher);
+				expected = lower;
+				expected.insert(higher.begin(), higher.end());
+
+				if (random.Next(0, 1) == 0)
+				{
+					list.Join(upper);
+					if (upper.Count() != 0 || upper.begin() != upper.end()) ++mismatches;
+				}
+				else
+				{
+					upper.Join(list);
+					if (list.Count() != 0 || list.begin() != list.end()) ++mismatches;
+					list = move(upper);
+				}
+				if (!SameElements(list, expected) || list.Count() != expected.size()) ++mismatches;
+				for (var i = 0; i < keyRange; ++i)
+				{
+					if (list.ContainsKey(i) != (expected.count(i) != 0)) ++mismatches;
+				}
+			}
+
+			TList empty;
+			list.Join(empty);
+			empty.Join(list);
+			if (list.Count() != 0 || !SameElements(empty, expected)) ++mismatches;
+			list = move(empty);
+
+			if (expected.size() >= 2)
+			{
+				TList middle;
+				middle[next(expected.begin())->first] = -1;
+				try
+				{
+					list.Join(middle);
+					++mismatches;
+				}
+				catch (const invalid_argument &) { }
+				try
+				{
+					middle.Join(list);
+					++mismatches;
+				}
+				catch (const invalid_argument &) { }
+				if (!SameElements(list, expected) || middle.Count() != 1) ++mismatches;
+			}
+			return mismatches;
+		}
+
+		// Each round fills two lists with random IndexSet and Remove operations, of similar sizes or about 1:100 either way
+		// so the galloping paths are taken, and applies MergeFrom, Union, Intersect and Difference to clones of them,
+		// comparing the results with the same operations on std::map, where resolve decides the value of a key in both.
+		// Every other round removes lazily, so the operations meet tombstones. Returns the number of mismatches.
+		template<class TList, typename TResolve>
+		static SizeType VerifySetOperations(TResolve resolve, SizeType rounds, uint seed = 1)
+		{
+			Random random(seed);
+			SizeType mismatches = 0;
+			var fill = [&random](TList &list, map<int, int> &model, int count, int keyRange)
+			{
+				for (var i = 0; i < 2 * count; ++i)
+				{
+					var key = random.Next(0, keyRange - 1);
+					if (random.Next(0, 3) != 0)
+					{
+						var value = random.Next(0, 1000 * 1000);
+						list[key] = value;
+						model[key] = value;
+					}
+					else
+					{
+						list.Remove(key);
+						model.erase(key);
+					}
+				}
+			};
+
+			for (SizeType round = 0; round < rounds; ++round)
+			{
+				static const int sizes[][2] = { { 500, 500 }, { 2000, 20 }, { 20, 2000 } };
+				var leftSize = sizes[round % 3][0];
+				var rightSize = sizes[round % 3][1];
+				var keyRange = 2 * max(leftSize, rightSize);
+				TList left, right;
+				if (round % 2 != 0)
+				{
+					left.EnableLazyRemoval(1);
+					right.EnableLazyRemoval(1);
+				}
+				map<int, int> leftModel, rightModel;
+				fill(left, leftModel, leftSize, keyRange);
+				fill(right, rightModel, rightSize, keyRange);
+
+				var merged = leftModel;
+				for (const var &item : rightModel)
+				{
+					var it = merged.find(item.first);
+					if (it == merged.end()) merged.insert(item);
+					else resolve(it->second, item.second);
+				}
+				map<int, int> intersection, difference;
+				for (var item : leftModel)
+				{
+					var it = rightModel.find(item.first);
+					if (it == rightModel.end()) difference.insert(item);
+					else
+					{
+						resolve(item.second, it->second);
+						intersection.insert(item);
+					}
+				}
+
+				var result = left.Clone();
+				var other = right.Clone();
+				result.MergeFrom(other, resolve);
+				if (!SameElements(result, merged) || result.Count() != merged.size()) ++mismatches;
+				if (other.Count() != 0 || other.begin() != other.end()) ++mismatches;
+
+				result = left.Clone();
+				result.Union(right, resolve);
+				if (!SameElements(result, merged) || result.Count() != merged.size()) ++mismatches;
+
+				result = left.Clone();
+				result.Intersect(right, resolve);
+				if (!SameElements(result, intersection) || result.Count() != intersection.size()) ++mismatches;
+
+				result = left.Clone();
+				result.Difference(right);
+				if (!SameElements(result, difference) || result.Count() != difference.size()) ++mismatches;
+
+				if (!SameElements(left, leftModel) || !SameElements(right, rightModel)) ++mismatches;
+			}
+			return mismatches;
+		}
+
+		// Applies the same random Set and Remove operations to the list, which aggregates with SumMonoid<int>, and to a std::map,
+		// over keys in [0, keyRange). After each operation it compares Count, Rank and Select of the key,
+		// and CountRange and Aggregate of a random range. Returns the number of mismatches.
+		template<class TList>
+		static SizeType VerifyIndexableSkipList(TList &list, SizeType operations, int keyRange, uint seed = 1)
+		{
+			map<int, int> expected;
+			Random random(seed);
+			SizeType mismatches = 0;
+			for (SizeType i = 0; i < operations; ++i)
+			{
+				var key = random.Next(0, keyRange - 1);
+				var value = random.Next(0, 1000);
+				if (random.Next(0, 2) != 0)
+				{
+					var added = expected.count(key) == 0;
+					expected[key] = value;
+					if (list.Set(key, value) != added) ++mismatches;
+				}
+				else if (list.Remove(key) != (expected.erase(key) != 0)) ++mismatches;
+				if (list.Count() != expected.size()) ++mismatches;
+
+				var rank = static_cast<SizeType>(distance(expected.begin(), expected.lower_bound(key)));
+				if (list.Rank(key) != rank) ++mismatches;
+				var selected = list.Select(rank);
+				if (rank < expected.size() ? selected == list.end() || selected->first != expected.lower_bound(key)->first : selected != list.end()) ++mismatches;
+
+				var lo = random.Next(0, keyRange - 1);
+				var hi = random.Next(0, keyRange - 1);
+				SizeType count = 0;
+				var sum = 0;
+				for (var it = expected.lower_bound(lo); lo < hi && it != expected.end() && it->first < hi; ++it)
+				{
+					++count;
+					sum += it->second;
+				}
+				if (list.CountRange(lo, hi) != count || list.Aggregate(lo, hi) != sum) ++mismatches;
+				if ((i + 1) % keyRange == 0 && !SameElements(list, expected)) ++mismatches;
+			}
+			if (!SameElements(list, expected)) ++mismatches;
+			return mismatches;
+		}
+
+		// Applies the same random Put, TryGetValue, Remove and Advance operations to a cache of the budget and to a model of it,
+		// a std::map with a list in eviction order, over keys in [0, keyRange). Costs go up to 3 and some entries get a time
+		// to live, a few of them long enough to cascade through every level of the timing wheel.
+		// The cache is built with the eviction policy, whose Clock value gives referenced entries a second chance in the model.
+		// After each operation it compares Count, Cost, Evictions and Expirations, and every keyRange operations the entries.
+		// Returns the number of mismatches.
+		template<class TCache, typename TEviction>
+		static SizeType VerifySkipListCache(SizeType budget, TEviction eviction, SizeType operations, int keyRange, uint seed = 1)
+		{
+			struct ModelEntry
+			{
+				int Value;
+				SizeType Cost;
+				UInt64 Expiry;
+				bool Referenced;
+			};
+
+			TCache cache(budget, eviction);
+			map<int, ModelEntry> expected;
+			list<int> order;			// Oldest first
+			SizeType cost = 0;
+			UInt64 now = 0;
+			UInt64 evictions = 0;
+			UInt64 expirations = 0;
+			Random random(seed);
+			SizeType mismatches = 0;
+
+			var erase = [&](int key)
+			{
+				cost -= expected[key].Cost;
+				expected.erase(key);
+				order.remove(key);
+			};
+
+			for (SizeType i = 0; i < operations; ++i)
+			{
+				var key = random.Next(0, keyRange - 1);
+				var operation = random.Next(0, 9);
+				if (operation < 4)
+				{
+					var value = random.Next();
+					SizeType entryCost = random.Next(1, 3);
+					var ttlKind = random.Next(0, 99);
+					UInt64 ttl = ttlKind < 60 ? 0 : ttlKind < 98 ? random.Next(1, 300) : random.Next(1, 1 << 20);
+					cache.Put(key, value, entryCost, ttl);
+
+					if (expected.count(key) != 0) erase(key);
+					expected[key] = ModelEntry{ value, entryCost, ttl == 0 ? 0 : now + ttl, false };
+					order.push_back(key);
+					cost += entryCost;
+					while (cost > budget && !order.empty())
+					{
+						while (eviction == TEviction::Clock && expected[order.front()].Referenced)
+						{
+							expected[order.front()].Referenced = false;
+							order.push_back(order.front());
+							order.pop_front();
+						}
+						++evictions;
+						erase(order.front());
+					}
+				}
+				else if (operation < 7)
+				{
+					int value;
+					var found = expected.find(key);
+					if (cache.TryGetValue(key, value) != (found != expected.end())) ++mismatches;
+					else if (found != expected.end())
+					{
+						if (value != found->second.Value) ++mismatches;
+						if (eviction == TEviction::Clock) found->second.Referenced = true;
+						else
+						{
+							order.remove(key);
+							order.push_back(key);
+						}
+					}
+				}
+				else if (operation < 8)
+				{
+					var removed = expected.count(key) != 0;
+					if (removed) erase(key);
+					if (cache.Remove(key) != removed) ++mismatches;
+				}
+				else
+				{
+					UInt64 ticks = random.Next(0, 9) == 0 ? random.Next(1, 1 << 16) : random.Next(1, 20);
+					cache.Advance(ticks);
+					now += ticks;
+					vector<int> expired;
+					for (var &item : expected)
+					{
+						if (item.second.Expiry != 0 && item.second.Expiry <= now) expired.push_back(item.first);
+					}
+					for (var expiredKey : expired)
+					{
+						++expirations;
+						erase(expiredKey);
+					}
+				}
+				if (cache.Count() != expected.size() || cache.Cost() != cost || cache.Now() != now) ++mismatches;
+				if (cache.Evictions() != evictions || cache.Expirations() != expirations) ++mismatches;
+				if ((i + 1) % keyRange == 0 && !SameEntries(cache.Items(), expected)) ++mismatches;
+			}
+			if (!SameEntries(cache.Items(), expected)) ++mismatches;
+			return mismatches;
+		}
+
+		static void PrintTestResult(const map<UInt32, Int64> &result, SizeType itemsNum, UInt32 opsPerItem = 4)
+		{
+			printf("%-20s%-20s%-20s\n", "Threads", "Milliseconds", "Ops/ms");
+			for (var &item : result)
+			{
+				printf("%-20u%-20lld%-20.1f\n", item.first, static_cast<long long>(item.second), 1.0 * opsPerItem * itemsNum / (item.second == 0 ? 1 : item.second));
+			}
+		}
+
 		static void PrintTestResult(const map<string, Int64> &result)
 		{
 			for (var &item : result)
@@ -160,8 +933,36 @@ namespace FclEx
 
 			for (var &item : result)
 			{
-				printf("%-20lld", item.second);
+				printf("%-20lld", static_cast<long long>(item.second));
+			}
+		}
+
+	private:
+
+		// Whether iterating the collection gives the elements of the expected map, in order.
+		template<class TDic, typename TKey, typename TValue>
+		static bool SameElements(const TDic &dic, const map<TKey, TValue> &expected)
+		{
+			var it = expected.begin();
+			for (var item : dic)
+			{
+				if (it == expected.end() || item.first != it->first || item.second != it->second) return false;
+				++it;
+			}
+			return it == expected.end();
+		}
+
+		// Whether the entries of a cache hold the values of the expected map, in order.
+		template<class TList, typename TKey, typename TEntry>
+		static bool SameEntries(const TList &items, const map<TKey, TEntry> &expected)
+		{
+			var it = expected.begin();
+			for (var &item : items)
+			{
+				if (it == expected.end() || item.first != it->first || item.second.Value != it->second.Value) return false;
+				++it;
 			}
+			return it == expected.end();
 		}
 	};
 }
@@ -0,0 +1,585 @@
+#pragma once
+
+#include "Define.h"
+#include "IKeyValueCollection.h"
+#include "Random.hpp"
+#include "SkipListLevel.hpp"
+#include "Comparer.hpp"
+#include "SimdHelper.hpp"
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include "NonCopyable.hpp"
+
+namespace FclEx
+{
+	namespace Collections
+	{
+		using namespace std;
+
+		// A node of an UnrolledSkipList holds up to Capacity elements, sorted, with keys and values in separate arrays
+		// so that the keys of a node are searched as one block. The tower of links follows, allocated inline as in SkipListNode.
+		template<typename TKey, typename TValue, SizeType Capacity, typename Allocator>
+		class UnrolledSkipListNode
+		{
+		public:
+
+			using PNode = UnrolledSkipListNode*;
+
+			TKey Keys[Capacity];
+			TValue Values[Capacity];
+			UInt32 Size;
+
+			static PNode Create(SizeType level)
+			{
+				if (level <= 0) throw std::invalid_argument("level");
+				ByteAllocator allocator;
+				var memory = allocator.allocate(AllocationSize(level));
+				return ::new (static_cast<void*>(memory)) UnrolledSkipListNode(level);
+			}
+
+			static void Destroy(PNode node) noexcept
+			{
+				var size = AllocationSize(node->_height);
+				node->~UnrolledSkipListNode();
+				ByteAllocator().deallocate(reinterpret_cast<char*>(node), size);
+			}
+
+			UnrolledSkipListNode(const UnrolledSkipListNode &) = delete;
+			UnrolledSkipListNode& operator=(const UnrolledSkipListNode &) = delete;
+
+			PNode Next() const
+			{
+				return NeighborNodes[0];
+			}
+
+			SizeType Height() const
+			{
+				return _height;
+			}
+
+		private:
+
+			using ByteAllocator = typename allocator_traits<Allocator>::template rebind_alloc<char>;
+
+			UInt32 _height;
+
+		public:
+
+			// Declared with one slot, but Create() allocates room for Height() slots.
+			PNode NeighborNodes[1];
+
+		private:
+
+			explicit UnrolledSkipListNode(SizeType level) :
+				Size(0),
+				_height(static_cast<UInt32>(level))
+			{
+				for (SizeType i = 0; i < level; ++i)
+				{
+					NeighborNodes[i] = nullptr;
+				}
+			}
+
+			~UnrolledSkipListNode() = default;
+
+			static constexpr SizeType AllocationSize(SizeType level)
+			{
+				return sizeof(UnrolledSkipListNode) + (level - 1) * sizeof(PNode);
+			}
+		};
+
+		// Iterates the elements of an UnrolledSkipList, node by node and within a node index by index.
+		// The keys and values are stored apart, so an element is a pair of references rather than a pair in the node.
+		template<typename TKey, typename TValue, typename TNode>
+		class UnrolledSkipListIterator
+		{
+		public:
+			typedef forward_iterator_tag			iterator_category;
+			typedef pair<TKey, TValue>				value_type;
+			typedef ptrdiff_t						difference_type;
+			typedef pair<const TKey&, TValue&>		reference;
+
+			// Lets it->second work on the pair of references.
+			class pointer
+			{
+			public:
+				explicit pointer(reference item) : _item(item) { }
+
+				reference *operator->()
+				{
+					return &_item;
+				}
+
+			private:
+				reference _item;
+			};
+
+			UnrolledSkipListIterator(TNode *node, SizeType index) : _node(node), _index(index) { }
+
+			const TKey &Key() const
+			{
+				return _node->Keys[_index];
+			}
+
+			TValue &Value() const
+			{
+				return _node->Values[_index];
+			}
+
+			reference operator*() const
+			{
+				return reference(_node->Keys[_index], _node->Values[_index]);
+			}
+
+			pointer operator->() const
+			{
+				return pointer(operator*());
+			}
+
+			UnrolledSkipListIterator &operator++()
+			{
+				if (++_index == _node->Size)
+				{
+					_node = _node->Next();
+					_index = 0;
+				}
+				return *this;
+			}
+
+			UnrolledSkipListIterator operator++(int)
+			{
+				UnrolledSkipListIterator old(*this);
+				operator++();
+				return old;
+			}
+
+			bool operator==(const UnrolledSkipListIterator &other) const
+			{
+				return _node == other._node && _index == other._index;
+			}
+
+			bool operator!=(const UnrolledSkipListIterator &other) const
+			{
+				return !operator==(other);
+			}
+
+		private:
+			TNode *_node;
+			SizeType _index;
+		};
+
+		// Finds the position of a key among the sorted keys of a node: the number of keys less than it.
+		// 32 and 64 bit integer keys in their natural order are compared with SIMD, anything else one key at a time.
+		template<typename TKey, typename TLess, typename = void>
+		struct UnrolledKeySearch
+		{
+			static SizeType CountLess(const TKey *keys, SizeType count, const TKey &key, const Comparer<TKey, TLess> &comparer)
+			{
+				SizeType i = 0;
+				while (i < count && comparer.Less(keys[i], key))
+				{
+					++i;
+				}
+				return i;
+			}
+		};
+
+		template<typename TKey, typename TLess>
+		struct UnrolledKeySearch<TKey, TLess, typename enable_if<is_integral<TKey>::value && (sizeof(TKey) == 4 || sizeof(TKey) == 8)
+			&& (is_same<TLess, less<TKey>>::value || is_same<TLess, less<>>::value)>::type>
+		{
+			static SizeType CountLess(const TKey *keys, SizeType count, const TKey &key, const Comparer<TKey, TLess> &)
+			{
+				return SimdHelper::CountLess(keys, count, key);
+			}
+		};
+
+		// A skip list over nodes of up to NodeCapacity elements, for fixed-width keys and values.
+		// The towers index nodes, i.e. runs of keys, by their first key, so the list has far fewer towers and levels
+		// than a SkipList, a search ends with one vector compare over a node's keys, and a scan reads keys and values
+		// sequentially. A full node is split in half; a node that can be merged into half a node with its successor is.
+		template<typename TKey,
+			typename TValue,
+			typename TLess = less<TKey>,
+			typename Allocator = allocator<pair<TKey, TValue>>>
+			class UnrolledSkipList : IKeyValueCollection<TKey, TValue>, NonCopyable
+		{
+			static_assert(is_trivially_copyable<TKey>::value && is_trivially_copyable<TValue>::value, "Keys and values must be trivially copyable.");
+
+		public:
+
+			// Two cache lines of keys per node.
+			static constexpr SizeType NodeCapacity = 128 / sizeof(TKey) < 4 ? 4 : 128 / sizeof(TKey);
+
+			using Node = UnrolledSkipListNode<TKey, TValue, NodeCapacity, Allocator>;
+			using PNode = typename Node::PNode;
+			using ItemType = pair<TKey, TValue>;
+			using Iterator = UnrolledSkipListIterator<TKey, TValue, Node>;
+
+			UnrolledSkipList() :
+				_head(Node::Create(MaxLevel)),
+				_nil(null)
+			{
+				Initialize();
+			}
+
+			~UnrolledSkipList() noexcept
+			{
+				var p = _head;
+				while (p != _nil)
+				{
+					var q = p;
+					p = p->Next();
+					Node::Destroy(q);
+				}
+			}
+
+			Iterator begin() const
+			{
+				return Iterator(_head->Next(), 0);
+			}
+
+			Iterator end() const
+			{
+				return Iterator(_nil, 0);
+			}
+
+			// The first element whose key is not less than the key.
+			Iterator lower_bound(const TKey &key) const
+			{
+				var node = FindNode(key);
+				var index = node == _head ? 0 : IndexOf(node, key);
+				if (node == _head || index == node->Size)
+				{
+					node = node->Next();
+					index = 0;
+				}
+				return Iterator(node, index);
+			}
+
+			SizeType Count() const override
+			{
+				return _count;
+			}
+
+			// The number of nodes, each holding at least one element.
+			SizeType NodesCount() const
+			{
+				return _nodesCount;
+			}
+
+			void Add(const ItemType &item) override
+			{
+				bool inserted;
+				Insert(item.first, item.second, inserted);
+			}
+
+			void Add(const TKey& key, const TValue& value) override
+			{
+				bool inserted;
+				Insert(key, value, inserted);
+			}
+
+			void Clear() override
+			{
+				var p = _head->Next();
+				while (p != _nil)
+				{
+					var q = p;
+					p = p->Next();
+					Node::Destroy(q);
+				}
+				Initialize();
+			}
+
+			bool Contains(const ItemType &item) const override
+			{
+				var it = Find(item.first);
+				return it != end() && _valueComparer.Equals(it.Value(), item.second);
+			}
+
+			bool Remove(const ItemType &item) override
+			{
+				return Remove(item.first, true, item.second);
+			}
+
+			//// index-get
+			const TValue& operator[](const TKey& key) const override
+			{
+				var it = Find(key);
+				return it == end() ? _defaultValue : it.Value();
+			}
+
+			//// index-set
+			TValue& operator[](const TKey& key) override
+			{
+				bool inserted;
+				return Insert(key, default(TValue), inserted).Value();
+			}
+
+			bool ContainsKey(const TKey& key) const override
+			{
+				return Find(key) != end();
+			}
+
+			bool ContainsValue(const TValue& value) const override
+			{
+				for (var p = _head->Next(); p != _nil; p = p->Next())
+				{
+					for (SizeType i = 0; i < p->Size; ++i)
+					{
+						if (_valueComparer.Equals(p->Values[i], value)) return true;
+					}
+				}
+				return false;
+			}
+
+			bool Remove(const TKey& key) override
+			{
+				return Remove(key, false);
+			}
+
+			// The element with the key, or end().
+			Iterator Find(const TKey &key) const
+			{
+				var node = FindNode(key);
+				if (node == _head) return end();
+				var index = IndexOf(node, key);
+				return index < node->Size && !_comparer.Less(key, node->Keys[index]) ? Iterator(node, index) : end();
+			}
+
+		private:
+
+			static constexpr UInt32 MaxLevel = 32;			// Maximum level any node in a skip list can have
+			static constexpr double Probability = 0.5;		// Probability factor used to determine the node level
+			const PNode _head;								// The skip list header.
+			const PNode _nil;								//  NIL node.
+
+			Int32 _listLevel;								// Current maximum list level.
+			UInt32 _count;									// Current number of elements in the skip list.
+			UInt32 _nodesCount;								// Current number of nodes.
+			const TValue _defaultValue = default(TValue);
+			const Comparer<TKey, TLess> _comparer;
+			const Comparer<TValue> _valueComparer;
+			const Random _random;
+
+			Int32 GetNewLevel() const
+			{
+				return NewLevel(_random, _listLevel, MaxLevel, Probability);
+			}
+
+			SizeType IndexOf(PNode node, const TKey &key) const
+			{
+				return UnrolledKeySearch<TKey, TLess>::CountLess(node->Keys, node->Size, key, _comparer);
+			}
+
+			// The last node whose first key is not greater than the key, or the head.
+			PNode FindNode(const TKey &key) const
+			{
+				var p = _head;
+				for (var i = _listLevel - 1; i >= 0; --i)
+				{
+					var next = p->NeighborNodes[i];
+					while (next != _nil && !_comparer.Less(key, next->Keys[0]))
+					{
+						p = next;
+						next = p->NeighborNodes[i];
+					}
+				}
+				return p;
+			}
+
+			// Fills prevNodes with the last node of every level whose first key is less than the key.
+			void FindPrevNodes(const TKey &key, PNode *prevNodes) const
+			{
+				var p = _head;
+				for (var i = _listLevel - 1; i >= 0; --i)
+				{
+					var next = p->NeighborNodes[i];
+					while (next != _nil && _comparer.Less(next->Keys[0], key))
+					{
+						p = next;
+						next = p->NeighborNodes[i];
+					}
+					prevNodes[i] = p;
+				}
+			}
+
+			// Inserts the element unless its key exists, and returns the element with the key.
+			Iterator Insert(const TKey &key, const TValue &value, bool &inserted)
+			{
+				PNode prevNodes[MaxLevel];
+				FindPrevNodes(key, prevNodes);
+				var node = prevNodes[0];
+				var next = node->Next();
+				inserted = false;
+				if (next != _nil && !_comparer.Less(key, next->Keys[0])) return Iterator(next, 0);
+
+				SizeType index = 0;
+				if (node == _head)
+				{
+					if (next == _nil)
+					{
+						// The first node.
+						node = Node::Create(GetNewLevel());
+						Link(node, prevNodes);
+					}
+					else
+					{
+						// The key becomes the first of the first node.
+						node = next;
+					}
+				}
+				else
+				{
+					index = IndexOf(node, key);
+					if (index < node->Size && !_comparer.Less(key, node->Keys[index])) return Iterator(node, index);
+				}
+
+				if (node->Size == NodeCapacity)
+				{
+					var upper = SplitNode(node, prevNodes);
+					if (index > node->Size)
+					{
+						index -= node->Size;
+						node = upper;
+					}
+				}
+
+				var tail = node->Size - index;
+				memmove(node->Keys + index + 1, node->Keys + index, tail * sizeof(TKey));
+				memmove(node->Values + index + 1, node->Values + index, tail * sizeof(TValue));
+				node->Keys[index] = key;
+				node->Values[index] = value;
+				++node->Size;
+				++_count;
+				inserted = true;
+				return Iterator(node, index);
+			}
+
+			bool Remove(const TKey &key, bool checkValue, const TValue &value = default(TValue))
+			{
+				PNode prevNodes[MaxLevel];
+				FindPrevNodes(key, prevNodes);
+				var node = prevNodes[0]->Next();
+				SizeType index = 0;
+				if (node == _nil || _comparer.Less(key, node->Keys[0]))
+				{
+					node = prevNodes[0];
+					if (node == _head) return false;
+					index = IndexOf(node, key);
+					if (index == node->Size || _comparer.Less(key, node->Keys[index])) return false;
+				}
+				if (checkValue && !_valueComparer.Equals(node->Values[index], value)) return false;
+
+				var tail = node->Size - index - 1;
+				memmove(node->Keys + index, node->Keys + index + 1, tail * sizeof(TKey));
+				memmove(node->Values + index, node->Values + index + 1, tail * sizeof(TValue));
+				--node->Size;
+				--_count;
+
+				if (node->Size == 0)
+				{
+					// Only a node whose first key was removed is found as the successor of prevNodes.
+					Unlink(node, prevNodes);
+					return true;
+				}
+				var next = node->Next();
+				if (next != _nil && node->Size + next->Size <= NodeCapacity / 2)
+				{
+					MergeNext(node, prevNodes);
+				}
+				return true;
+			}
+
+			// Moves the upper half of a full node into a new node linked after it, and returns the new node.
+			// prevNodes holds the nodes before the node's position at the levels above its height.
+			PNode SplitNode(PNode node, PNode *prevNodes)
+			{
+				var upper = Node::Create(GetNewLevel());
+				var half = static_cast<UInt32>(NodeCapacity / 2);
+				memcpy(upper->Keys, node->Keys + half, (node->Size - half) * sizeof(TKey));
+				memcpy(upper->Values, node->Values + half, (node->Size - half) * sizeof(TValue));
+				upper->Size = node->Size - half;
+				node->Size = half;
+
+				PNode upperPrevNodes[MaxLevel];
+				UpdatePrevNodes(node, prevNodes, upperPrevNodes);
+				Link(upper, upperPrevNodes);
+				return upper;
+			}
+
+			// Appends the elements of the node's successor to the node and removes the successor.
+			void MergeNext(PNode node, PNode *prevNodes)
+			{
+				var next = node->Next();
+				memcpy(node->Keys + node->Size, next->Keys, next->Size * sizeof(TKey));
+				memcpy(node->Values + node->Size, next->Values, next->Size * sizeof(TValue));
+				node->Size += next->Size;
+
+				PNode nextPrevNodes[MaxLevel];
+				UpdatePrevNodes(node, prevNodes, nextPrevNodes);
+				Unlink(next, nextPrevNodes);
+			}
+
+			// The nodes before the node that follows the node: the node itself below its height, and above it
+			// the nodes before the node, which no taller node separates from it.
+			void UpdatePrevNodes(PNode node, const PNode *prevNodes, PNode *result) const
+			{
+				var height = static_cast<Int32>(node->Height());
+				for (var i = 0; i < _listLevel; ++i)
+				{
+					result[i] = i < height ? node : prevNodes[i];
+				}
+			}
+
+			void Link(PNode newNode, PNode *prevNodes)
+			{
+				var newLevel = static_cast<Int32>(newNode->Height());
+				if (newLevel > _listLevel)
+				{
+					for (var i = _listLevel; i < newLevel; ++i)
+					{
+						prevNodes[i] = _head;
+					}
+					_listLevel = newLevel;
+				}
+				for (var i = 0; i < newLevel; ++i)
+				{
+					newNode->NeighborNodes[i] = prevNodes[i]->NeighborNodes[i];
+					prevNodes[i]->NeighborNodes[i] = newNode;
+				}
+				++_nodesCount;
+			}
+
+			void Unlink(PNode node, PNode *prevNodes)
+			{
+				for (var i = 0; i < static_cast<Int32>(node->Height()); i++)
+				{
+					prevNodes[i]->NeighborNodes[i] = node->NeighborNodes[i];
+				}
+				Node::Destroy(node);
+				--_nodesCount;
+				while (_listLevel > 1 && _head->NeighborNodes[_listLevel - 1] == _nil)
+				{
+					--_listLevel;
+				}
+			}
+
+			void Initialize()
+			{
+				for (decltype(_head->Height()) i = 0; i < _head->Height(); ++i)
+				{
+					_head->NeighborNodes[i] = _nil;
+				}
+				_listLevel = 1;
+				_count = 0;
+				_nodesCount = 0;
+			}
+		};
+	}
+}
@@ -1,6 +1,11 @@
 #pragma once
+#include <array>
 #include <vector>
 #include <numeric>
+#include <algorithm>
+#include <random>
+
+#include "Define.h"
 
 namespace FclEx
 {
@@ -40,5 +45,11 @@ namespace FclEx
 			//}
 			return ivec;
 		}
+
+		template<typename T>
+		static void Shuffle(vector<T> &source, uint seed = 0)
+		{
+			shuffle(source.begin(), source.end(), default_random_engine(seed));
+		}
 	};	
 }
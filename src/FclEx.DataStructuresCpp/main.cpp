@@ -1,6 +1,7 @@
 ﻿#include <vector>
 #include <string>
 #include <iostream>
+#include <fstream>
 
 #include "Define.h"
 #include "HuffmanTreeEncoder.h"
@@ -10,15 +11,30 @@
 #include <functional>
 #include "Test.hpp"
 #include "SkipList.hpp"
+#include "ConcurrentSkipList.hpp"
+#include "UnrolledSkipList.hpp"
+#include "SmallSkipList.hpp"
+#include "IndexableSkipList.hpp"
+#include "SkipListCache.hpp"
+#include "MappedSkipList.hpp"
+#include "LsmStore.hpp"
+#include "SkipListPriorityQueue.hpp"
 #include "MapHelper.hpp"
 #include "StringHelper.hpp"
 
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 using namespace std;
 using namespace FclEx;
 using namespace Algorithms::HuffmanTree;
 
 
-static void TestHuffmanEncoding(const vector<byte> &bytes)
+static void TestHuffmanEncoding(const vector<::byte> &bytes)
 {
 	cout << bytes.size() << endl;
 
@@ -49,6 +65,260 @@ static void TestKeyValueCollection()
 
 }
 
+static void VerifySkipList()
+{
+	SkipList<int, int> list;
+	printf("SkipList mismatches: %zu\n", Test::VerifyKeyValueCollection(list, 200 * 1000, 1000));
+}
+
+static void VerifyLazySkipList()
+{
+	// Removed keys stay as tombstones, get added again, and are unlinked whenever they reach a quarter of the list.
+	SkipList<int, int> list;
+	list.EnableLazyRemoval();
+	printf("Lazy SkipList mismatches: %zu\n", Test::VerifyKeyValueCollection(list, 200 * 1000, 1000));
+}
+
+static void VerifyCloneAndMove()
+{
+	using FilteredSkipList = SkipList<int, int, less<int>, allocator<pair<int, int>>, BlockedBloomFilter<int>>;
+	printf("SkipList clone and move mismatches: %zu\n", Test::VerifyCloneAndMove<SkipList<int, int>>(10 * 1000));
+	printf("Filtered SkipList clone and move mismatches: %zu\n", Test::VerifyCloneAndMove<FilteredSkipList>(10 * 1000));
+}
+
+static void VerifyBlockedBloomFilter()
+{
+	SizeType mismatches = 0;
+	BlockedBloomFilter<int> filter(1000);
+	for (var i = 0; i < 1000; ++i)
+	{
+		filter.Add(i);
+	}
+	// Allocations in between shift where the words of each copy start relative to a cache line.
+	vector<vector<char>> gaps;
+	vector<BlockedBloomFilter<int>> copies;
+	for (var i = 0; i < 8; ++i)
+	{
+		gaps.emplace_back(16 * i + 8);
+		copies.push_back(filter);
+		gaps.emplace_back(16 * i + 8);
+		copies.emplace_back();
+		copies.back() = filter;
+	}
+	for (const var &copy : copies)
+	{
+		for (var i = 0; i < 1000; ++i)
+		{
+			if (!copy.MayContain(i)) ++mismatches;
+		}
+	}
+
+	// Lookups by const char * go through the transparent comparer, and the filter hashes them as strings.
+	using FilteredSkipList = SkipList<string, int, less<>, allocator<pair<string, int>>, BlockedBloomFilter<string>>;
+	FilteredSkipList list;
+	for (var i = 0; i < 1000; ++i)
+	{
+		list.Add("key" + to_string(2 * i), i);
+	}
+	char key[32];
+	for (var i = 0; i < 2000; ++i)
+	{
+		snprintf(key, sizeof(key), "key%d", i);
+		if (list.ContainsKey(static_cast<const char *>(key)) != (i % 2 == 0)) ++mismatches;
+	}
+	if (list.Filter().Lookups() != 2000 || list.Filter().Rejections() == 0) ++mismatches;
+	printf("BlockedBloomFilter mismatches: %zu, string lookup hit rate: %.3f\n", mismatches, list.Filter().HitRate());
+}
+
+static void VerifySplitAndJoin()
+{
+	using FilteredSkipList = SkipList<int, int, less<int>, allocator<pair<int, int>>, BlockedBloomFilter<int>>;
+	printf("SkipList split and join mismatches: %zu\n", Test::VerifySplitAndJoin<SkipList<int, int>>(500, 300));
+	printf("Filtered SkipList split and join mismatches: %zu\n", Test::VerifySplitAndJoin<FilteredSkipList>(500, 300));
+}
+
+static void VerifySetOperations()
+{
+	printf("SkipList set operations (KeepExisting) mismatches: %zu\n", Test::VerifySetOperations<SkipList<int, int>>(KeepExisting(), 300));
+	printf("SkipList set operations (TakeIncoming) mismatches: %zu\n", Test::VerifySetOperations<SkipList<int, int>>(TakeIncoming(), 300, 2));
+}
+
+static void TestBatchLookup()
+{
+	auto items = VectorHelper::Range(1, 4 * 1000 * 1000);
+	VectorHelper::Shuffle(items);
+	SkipList<int, int> list;
+	for (auto item : items)
+	{
+		list.Add(item, item);
+	}
+
+	VectorHelper::Shuffle(items, 1);
+	auto result = Test::TestBatchLookup<int, SkipList<int, int>>(list, items, 64);
+	Test::PrintTestResult(result);
+}
+
+static void TestFilteredLookup()
+{
+	auto items = VectorHelper::Range(1, 1000 * 1000);
+	VectorHelper::Shuffle(items);
+	using FilteredSkipList = SkipList<int, int, less<int>, allocator<pair<int, int>>, BlockedBloomFilter<int>>;
+	SkipList<int, int> list;
+	FilteredSkipList filtered;
+	for (auto item : items)
+	{
+		list.Add(item * 2, item);
+		filtered.Add(item * 2, item);
+	}
+
+	// Four of five keys are missing, and fall between present ones.
+	vector<int> keys;
+	for (SizeType i = 0; i < items.size(); ++i)
+	{
+		keys.push_back(i % 5 == 0 ? items[i] * 2 : items[i] * 2 + 1);
+	}
+	Test::PrintTestResult(Test::TestBatchLookup<int, SkipList<int, int>>(list, keys, 64));
+	printf("\n");
+	Test::PrintTestResult(Test::TestBatchLookup<int, FilteredSkipList>(filtered, keys, 64));
+	printf("\nFilter hit rate: %.3f\n", filtered.Filter().HitRate());
+}
+
+static void TestValueIndex()
+{
+	auto items = VectorHelper::Range(1, 20 * 1000);
+	using IndexedSkipList = SkipList<int, int, less<int>, allocator<pair<int, int>>, NoKeyFilter, HashValueIndex<int, int>>;
+	SkipList<int, int> list;
+	IndexedSkipList indexed;
+	TestDic<int, SkipList<int, int>>::Add(list, items);
+	TestDic<int, IndexedSkipList>::Add(indexed, items);
+
+	map<string, Int64> result;
+	result["ContainsValue"] = Measure<>::Execution(TestDic<int, SkipList<int, int>>::ContainsValue, list, items);
+	result["IndexedContainsValue"] = Measure<>::Execution(TestDic<int, IndexedSkipList>::ContainsValue, indexed, items);
+	Test::PrintTestResult(result);
+}
+
+static void TestUnrolledScan()
+{
+	auto items = VectorHelper::Range(1, 1000 * 1000);
+	VectorHelper::Shuffle(items);
+
+	SkipList<int, int> list;
+	Test::PrintTestResult(Test::TestScan<int, SkipList<int, int>>(list, items, 10));
+	printf("\n");
+
+	UnrolledSkipList<int, int> unrolled;
+	Test::PrintTestResult(Test::TestScan<int, UnrolledSkipList<int, int>>(unrolled, items, 10));
+}
+
+static void VerifyUnrolledSkipList()
+{
+	// Enough keys to split and merge nodes of 32 keys.
+	UnrolledSkipList<int, int> list;
+	printf("UnrolledSkipList mismatches: %zu\n", Test::VerifyKeyValueCollection(list, 200 * 1000, 5000));
+}
+
+static void VerifySmallSkipList()
+{
+	// About half of 32 keys are present at a time, so the map keeps crossing its threshold of 16.
+	SmallSkipList<int, int> list;
+	printf("SmallSkipList mismatches: %zu\n", Test::VerifyKeyValueCollection(list, 200 * 1000, 32));
+}
+
+static void VerifyIndexableSkipList()
+{
+	IndexableSkipList<int, int, SumMonoid<int>> list;
+	printf("IndexableSkipList mismatches: %zu\n", Test::VerifyIndexableSkipList(list, 100 * 1000, 1000));
+}
+
+static void VerifySkipListCache()
+{
+	// A budget of 64 over 200 keys, so entries are evicted all the time.
+	printf("SkipListCache LRU mismatches: %zu\n", Test::VerifySkipListCache<SkipListCache<int, int>>(64, CacheEviction::Lru, 100 * 1000, 200));
+	printf("SkipListCache CLOCK mismatches: %zu\n", Test::VerifySkipListCache<SkipListCache<int, int>>(64, CacheEviction::Clock, 100 * 1000, 200));
+}
+
+static void VerifyMappedSkipList()
+{
+	const char *filename = "MappedSkipList.test";
+	remove(filename);
+	var mismatches = Test::VerifyReopen<MappedSkipList<int, int>>(filename, 10, 5000, 2000);
+	// A list level beyond MaxLevel, written where the header keeps it, must be refused on reopening.
+	{
+		fstream file(filename, ios::in | ios::out | ios::binary);
+		UInt32 level = 1000;
+		file.seekp(20);
+		file.write(reinterpret_cast<const char *>(&level), sizeof(level));
+	}
+	try
+	{
+		MappedSkipList<int, int> list(filename);
+		++mismatches;
+	}
+	catch (const runtime_error &) { }
+	remove(filename);
+	printf("MappedSkipList reopen mismatches: %zu\n", mismatches);
+}
+
+// Empties the directory and deletes it, when it exists.
+static void DeleteTestDirectory(const string &directory)
+{
+	for (auto &name : LsmFile::List(directory))
+	{
+		if (name != "." && name != "..") remove((directory + "/" + name).c_str());
+	}
+#ifdef _WIN32
+	_rmdir(directory.c_str());
+#else
+	rmdir(directory.c_str());
+#endif
+}
+
+static void VerifyLsmStore()
+{
+	const string directory = "LsmStore.test";
+	DeleteTestDirectory(directory);
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+	// A memtable of 256 entries over 20000 writes flushes dozens of runs, so compactions run in the background.
+	var mismatches = Test::VerifyLsmStore<LsmStore<int, int>>(directory, 20 * 1000, 2000, 256);
+	DeleteTestDirectory(directory);
+	printf("LsmStore mismatches: %zu\n", mismatches);
+}
+
+static void VerifyConcurrentSnapshot()
+{
+	auto maxThreads = thread::hardware_concurrency();
+	printf("ConcurrentSkipList snapshot mismatches: %zu\n",
+		Test::VerifySnapshot<ConcurrentSkipList<int, int>>(maxThreads < 2 ? 2 : maxThreads, 20, 20 * 1000, 1000));
+}
+
+static void TestConcurrentKeyValueCollection()
+{
+	auto items = VectorHelper::Range(1, 1000 * 1000);
+	auto maxThreads = thread::hardware_concurrency();
+
+	auto result = Test::TestConcurrentKeyValueCollection<int, ConcurrentSkipList<int, int>>(items, maxThreads == 0 ? 4 : maxThreads);
+	Test::PrintTestResult(result, items.size());
+}
+
+static void TestConcurrentPriorityQueue()
+{
+	auto items = VectorHelper::Range(1, 1000 * 1000);
+	VectorHelper::Shuffle(items);
+	auto maxThreads = thread::hardware_concurrency();
+	maxThreads = maxThreads == 0 ? 4 : maxThreads;
+
+	auto locked = Test::TestConcurrentPriorityQueue<int, LockedPriorityQueue<int, int>>(items, maxThreads);
+	Test::PrintTestResult(locked, items.size(), 2);
+
+	auto skipList = Test::TestConcurrentPriorityQueue<int, SkipListPriorityQueue<int, int>>(items, maxThreads);
+	Test::PrintTestResult(skipList, items.size(), 2);
+}
+
 
 int main(void)
 {
@@ -56,7 +326,7 @@ int main(void)
 	string str = "static_cast is the first cast you should attempt to use. It does things like implicit conversions between types (such as int to float, or pointer to void*), and it can also call explicit conversion functions (or implicit ones). In many cases, explicitly stating static_cast isn't necessary, but it's important to note that the T(something) syntax is equivalent to (T)something and should be avoided (more on that later). A T(something, something_else) is safe, however, and guaranteed to call the constructor.";	
 	SpeedTest__("压缩字符串用时：")
 	{
-		TestHuffmanEncoding(vector<byte>(str.begin(), str.end()));
+		TestHuffmanEncoding(vector<::byte>(str.begin(), str.end()));
 	}	
 
 	cout << "压缩文件" << endl;
@@ -68,7 +338,52 @@ int main(void)
 	 cin.get();
 
 
-	// TestKeyValueCollection();
+	VerifySkipList();
+
+	VerifyLazySkipList();
+
+	VerifyCloneAndMove();
+
+	VerifyBlockedBloomFilter();
+
+	VerifySplitAndJoin();
+
+	VerifySetOperations();
+
+	TestKeyValueCollection();
+	cout << endl;
+
+	TestBatchLookup();
+	cout << endl;
+
+	TestFilteredLookup();
+	cout << endl;
+
+	TestValueIndex();
+	cout << endl;
+
+	VerifyUnrolledSkipList();
+
+	TestUnrolledScan();
+	cout << endl;
+
+	VerifySmallSkipList();
+
+	VerifyIndexableSkipList();
+
+	VerifySkipListCache();
+
+	VerifyMappedSkipList();
+
+	VerifyLsmStore();
+
+	VerifyConcurrentSnapshot();
+
+	TestConcurrentKeyValueCollection();
+	cout << endl;
+
+	TestConcurrentPriorityQueue();
+	cout << endl;
 
 
 	cin.get();